@@ -14,13 +14,23 @@ CONFIG   -= app_bundle
 
 TEMPLATE = app
 
-INCLUDEPATH += /home/jim/boost_1_52_0
-LIBS += -L/home/jim/boost_1_52_0/stage/lib -lboost_system -lboost_thread -lboost_chrono
+# Boost 1.53 or later (Boost.Atomic)
+INCLUDEPATH += /home/jim/boost_1_53_0
+LIBS += -L/home/jim/boost_1_53_0/stage/lib -lboost_system -lboost_thread -lboost_chrono
 
 SOURCES += main.cpp \
     publisher.cpp \
-    subscriber.cpp
+    subscriber.cpp \
+    broadcast_ring.cpp \
+    filter_index.cpp \
+    topic_trie.cpp
 
 HEADERS += \
     publisher.h \
-    subscriber.h
+    subscriber.h \
+    message.h \
+    broadcast_ring.h \
+    rcu_ptr.h \
+    filter.h \
+    filter_index.h \
+    topic_trie.h
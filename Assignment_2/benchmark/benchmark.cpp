@@ -0,0 +1,445 @@
+#include <iomanip>
+#include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/random_number_generator.hpp>
+#include "latency_histogram.h"
+#include "publisher.h"
+#include "subscriber.h"
+
+/* ---------------------------------------------------------------------------------------------
+ * Publishers-Subscribers fan-out benchmark
+ * ---------------------------------------------------------------------------------------------
+ * Usage: takes up to 5 arguements (or none -> default) as follows
+ *
+ *               1st arguement: delivery mode ("wait", "conflate" or "ring")
+ *               2nd arguement: duration of each run in seconds
+ *               3rd arguement: random seed for the topology
+ *               4th arguement: messages per publish (1: Publish, more: PublishBatch)
+ *               5th arguement: message keys (0: no filters, more: each subscriber filters
+ *                              on one random key, checked by the readers in "ring" mode)
+ * ---------------------------------------------------------------------------------------------
+ * Default options:
+ *                 delivery mode: [wait]
+ *                      duration: [1] second per run
+ *                          seed: [1]
+ *                    batch size: [1] message
+ *                          keys: [0] (no filters)
+ * ---------------------------------------------------------------------------------------------
+ * Runs every point of the (publishers x subscribers x connections per subscriber) matrix:
+ *  - the same seed always gives the same topology
+ *  - publishers publish without sleeping, subscribers record instead of displaying
+ *  - reports publish rate, delivered messages rate and publish-to-receive latency percentiles
+ * ---------------------------------------------------------------------------------------------
+ * Topic matching: "match [subscriptions] [seed]" instead
+ *  - registers (seeded) random topic patterns, mostly exact, some with "*" or "#"
+ *  - reports the time per match, with cold (trie) and warm (cached) topics
+ *  - then with random topics out of all of them, a working set larger than the topic cache (evicting)
+ *  - then a pattern of many "#" levels against a deep topic, alone and in a trie (cost stays linear)
+ * ---------------------------------------------------------------------------------------------
+ */
+
+const int kPubCounts[] = {1, 2, 4, 8};      // publishers per run
+const int kSubCounts[] = {1, 4, 16, 64};    // subscribers per run
+const int kConCounts[] = {1, 2, 4, 8};      // connections per subscriber (up to the publishers count)
+const unsigned kRingCapacity = 1024;        // slots per publisher ring ("ring" mode)
+const int kHashPatternLevels = 64;          // "#" levels of the worst-case pattern ("match" mode)
+const int kDeepTopicLevels = 14;            // levels of the topic it is matched against
+
+/*
+ * Structure that holds the benchmark options
+ */
+struct Options { std::string delivery; int seconds, batch_size, key_count; unsigned seed;};
+
+/*
+ * Structure that holds a subscriber's measurements (updated by the subscriber's thread only)
+ */
+struct SubscriberStats
+{
+    SubscriberStats() : delivered(0) {}
+
+    void Record(const Message& msg)
+    {
+        boost::chrono::nanoseconds elapsed = boost::chrono::steady_clock::now() - msg.published_at;
+        latency.Record(elapsed.count() > 0 ? elapsed.count() : 0);
+        delivered++;
+    }
+
+    unsigned long delivered;
+    LatencyHistogram latency;  // nanoseconds
+};
+
+void SetOptions(int num_of_args, char* arg_vector[], Options& opt);
+void RunPoint(const Options& opt, int num_of_pub, int num_of_sub, int num_of_con);
+void RunTopicMatch(int num_of_subscriptions, unsigned seed);
+
+/*
+ * Main function
+ */
+int main(int argc, char* argv[])
+{
+    // topic matching only
+    if ((argc > 1) && (std::string(argv[1]) == "match"))
+    {
+        RunTopicMatch((argc > 2) ? (int) strtod(argv[2], NULL) : 100000,
+                      (argc > 3) ? (unsigned) strtod(argv[3], NULL) : 1);
+        return 0;
+    }
+
+    Options options;
+    SetOptions(argc, argv, options);
+
+    std::cout << "# delivery: " << options.delivery
+              << ", duration: " << options.seconds << " s"
+              << ", seed: " << options.seed
+              << ", batch size: " << options.batch_size
+              << ", keys: " << options.key_count << std::endl
+              << std::setw(5) << "pubs" << std::setw(6) << "subs" << std::setw(6) << "cons"
+              << std::setw(14) << "publish/s" << std::setw(14) << "delivered/s"
+              << std::setw(10) << "p50(us)" << std::setw(10) << "p90(us)"
+              << std::setw(10) << "p99(us)" << std::setw(11) << "p99.9(us)"
+              << std::setw(10) << "max(us)" << std::endl;
+
+    for (unsigned p=0; p<sizeof(kPubCounts)/sizeof(int); p++)
+    {
+        for (unsigned s=0; s<sizeof(kSubCounts)/sizeof(int); s++)
+        {
+            for (unsigned c=0; c<sizeof(kConCounts)/sizeof(int); c++)
+            {
+                if (kConCounts[c] <= kPubCounts[p])
+                {
+                    RunPoint(options, kPubCounts[p], kSubCounts[s], kConCounts[c]);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Runs and reports one point of the matrix
+ */
+void RunPoint(const Options& opt, int num_of_pub, int num_of_sub, int num_of_con)
+{
+    bool is_ring = (opt.delivery == "ring");
+
+    // create publishers
+    boost::scoped_array<Publisher> pubs(new Publisher[num_of_pub]);
+    for (int i=0; i<num_of_pub; i++)
+    {
+        pubs[i].set_id(i+1);
+        pubs[i].set_throttled(false);
+        pubs[i].set_batch_size(opt.batch_size);
+        pubs[i].set_key_count(std::max(opt.key_count, 1));
+        if (is_ring)
+        {
+            pubs[i].EnableRing(kRingCapacity, 0);
+        }
+    }
+
+    // create subscribers, recording instead of displaying
+    boost::scoped_array<Subscriber> subs(new Subscriber[num_of_sub]);
+    boost::scoped_array<SubscriberStats> stats(new SubscriberStats[num_of_sub]);
+    for (int i=0; i<num_of_sub; i++)
+    {
+        subs[i].set_id(i+1);
+        subs[i].set_conflate(opt.delivery == "conflate");
+        subs[i].set_handler(boost::bind(&SubscriberStats::Record, &stats[i], _1));
+    }
+
+    // connect each subscriber to num_of_con distinct publishers, filtering on a random key if asked
+    // (reproducible for a given seed)
+    boost::random::mt19937 generator(opt.seed);
+    boost::random::random_number_generator<boost::random::mt19937> random_index(generator);
+    std::vector<int> indices(num_of_pub);
+    for (int i=0; i<num_of_pub; i++)
+    {
+        indices[i] = i;
+    }
+    for (int i=0; i<num_of_sub; i++)
+    {
+        Filter filter;
+        if (opt.key_count > 0)
+        {
+            filter.AddKey(random_index(opt.key_count));
+        }
+
+        std::random_shuffle(indices.begin(), indices.end(), random_index);
+        for (int j=0; j<num_of_con; j++)
+        {
+            if (is_ring)
+            {
+                pubs[indices[j]].AddReader(subs[i], filter);
+            }
+            else
+            {
+                subs[i].Subscribe(pubs[indices[j]], filter);
+            }
+        }
+    }
+
+    // launch subscribers first, then publishers
+    boost::thread_group sub_threads, pub_threads;
+    for (int i=0; i<num_of_sub; i++)
+    {
+        if (is_ring)
+        {
+            sub_threads.create_thread(boost::bind(&Subscriber::ReadRings, &subs[i]));
+        }
+        else
+        {
+            sub_threads.create_thread(boost::bind(&Subscriber::DisplayMessage, &subs[i]));
+        }
+    }
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    for (int i=0; i<num_of_pub; i++)
+    {
+        pub_threads.create_thread(boost::bind(&Publisher::PublishData, &pubs[i]));
+    }
+
+    boost::this_thread::sleep_for(boost::chrono::seconds(opt.seconds));
+
+    // stop publishers (subscribers still running, so that no publisher is left waiting), then subscribers
+    for (int i=0; i<num_of_pub; i++)
+    {
+        pubs[i].Stop();
+    }
+    pub_threads.join_all();
+    double elapsed = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+
+    for (int i=0; i<num_of_sub; i++)
+    {
+        subs[i].Stop();
+    }
+    sub_threads.join_all();
+
+    // gather the measurements
+    unsigned long published = 0,
+                  delivered = 0;
+    LatencyHistogram latency;
+    for (int i=0; i<num_of_pub; i++)
+    {
+        published += pubs[i].published();
+    }
+    for (int i=0; i<num_of_sub; i++)
+    {
+        delivered += stats[i].delivered;
+        latency.Merge(stats[i].latency);
+    }
+
+    std::cout << std::fixed << std::setprecision(0)
+              << std::setw(5) << num_of_pub << std::setw(6) << num_of_sub << std::setw(6) << num_of_con
+              << std::setw(14) << published / elapsed << std::setw(14) << delivered / elapsed
+              << std::setprecision(1)
+              << std::setw(10) << latency.Percentile(50) / 1000.0
+              << std::setw(10) << latency.Percentile(90) / 1000.0
+              << std::setw(10) << latency.Percentile(99) / 1000.0
+              << std::setw(11) << latency.Percentile(99.9) / 1000.0
+              << std::setw(10) << latency.max() / 1000.0 << std::endl;
+}
+
+/*
+ * Measures topic matching against a number of subscriptions
+ *  - topics look like "<asset class>.<region>.<symbol>"
+ *  - subscriptions: 98% exact topics, 1.5% "<class>.<region>.*", 0.5% "<class>.#"
+ */
+void RunTopicMatch(int num_of_subscriptions, unsigned seed)
+{
+    const char* classes[] = {"eq", "fx", "fi", "cm"};
+    const char* regions[] = {"us", "eu", "ap"};
+    const int num_of_symbols = 2000;
+
+    boost::random::mt19937 generator(seed);
+    boost::random::random_number_generator<boost::random::mt19937> random_index(generator);
+
+    // every concrete topic
+    std::vector<std::string> topics;
+    for (int c=0; c<4; c++)
+    {
+        for (int r=0; r<3; r++)
+        {
+            for (int s=0; s<num_of_symbols; s++)
+            {
+                topics.push_back(std::string(classes[c]) + "." + regions[r] + ".S" +
+                                 boost::lexical_cast<std::string>(s));
+            }
+        }
+    }
+
+    // one filter per subscription
+    std::vector<Filter> filters(num_of_subscriptions);
+    for (int i=0; i<num_of_subscriptions; i++)
+    {
+        int kind = random_index(1000);
+        std::string asset_class = classes[random_index(4)],
+                    region = regions[random_index(3)];
+
+        if (kind < 5)
+        {
+            filters[i].AddTopic(asset_class + ".#");
+        }
+        else if (kind < 20)
+        {
+            filters[i].AddTopic(asset_class + "." + region + ".*");
+        }
+        else
+        {
+            filters[i].AddTopic(topics[random_index(topics.size())]);
+        }
+    }
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    FilterIndex index;
+    index.Compile(filters);
+    double compile_ms = boost::chrono::duration<double, boost::milli>(boost::chrono::steady_clock::now() - start).count();
+
+    // publish over a working set of topics: first pass cold (trie), then warm (cache)
+    std::vector<Message> messages(1000);
+    for (unsigned i=0; i<messages.size(); i++)
+    {
+        messages[i].key = 0;
+        messages[i].value = 0;
+        messages[i].topic = topics[random_index(topics.size())];
+    }
+
+    FilterIndex::Scratch scratch;
+    unsigned long matched = 0;
+    start = boost::chrono::steady_clock::now();
+    for (unsigned i=0; i<messages.size(); i++)
+    {
+        index.Match(messages[i], scratch);
+    }
+    double cold_ns = boost::chrono::duration<double, boost::nano>(boost::chrono::steady_clock::now() - start).count()
+                     / messages.size();
+
+    const int rounds = 1000;
+    start = boost::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++)
+    {
+        for (unsigned i=0; i<messages.size(); i++)
+        {
+            matched += index.Match(messages[i], scratch).size();
+        }
+    }
+    double warm_ns = boost::chrono::duration<double, boost::nano>(boost::chrono::steady_clock::now() - start).count()
+                     / (rounds * messages.size());
+
+    // random topics out of all of them (more than the cache holds)
+    std::vector<Message> sweep(10 * topics.size());
+    for (unsigned i=0; i<sweep.size(); i++)
+    {
+        sweep[i].key = 0;
+        sweep[i].value = 0;
+        sweep[i].topic = topics[random_index(topics.size())];
+    }
+
+    start = boost::chrono::steady_clock::now();
+    for (unsigned i=0; i<sweep.size(); i++)
+    {
+        index.Match(sweep[i], scratch);
+    }
+    double sweep_ns = boost::chrono::duration<double, boost::nano>(boost::chrono::steady_clock::now() - start).count()
+                      / sweep.size();
+
+    // a single pattern of many "#" levels against a deep topic: must stay linear, and right
+    std::string deep_topic = "l0",
+                hash_pattern;
+    for (int i=1; i<kDeepTopicLevels; i++)
+    {
+        deep_topic += ".l" + boost::lexical_cast<std::string>(i);
+    }
+    for (int i=0; i<kHashPatternLevels; i++)
+    {
+        hash_pattern += "#.";
+    }
+    std::string missing_pattern = hash_pattern + "zz",   // no level "zz"
+                found_pattern = hash_pattern + "l7.#";   // "l7" somewhere
+
+    unsigned long hash_errors = 0;
+    start = boost::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++)
+    {
+        hash_errors += TopicMatches(missing_pattern, deep_topic) ? 1 : 0;
+        hash_errors += TopicMatches(found_pattern, deep_topic) ? 0 : 1;
+    }
+    double hash_ns = boost::chrono::duration<double, boost::nano>(boost::chrono::steady_clock::now() - start).count()
+                     / (2 * rounds);
+
+    // the same patterns in a trie: only the second one matches
+    TopicTrie hash_trie;
+    hash_trie.Insert(missing_pattern, 0);
+    hash_trie.Insert(found_pattern, 1);
+    start = boost::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++)
+    {
+        hash_trie.Match(deep_topic, scratch.subscribers);
+        hash_errors += (scratch.subscribers.size() == 1 && scratch.subscribers[0] == 1) ? 0 : 1;
+    }
+    double hash_trie_ns = boost::chrono::duration<double, boost::nano>(boost::chrono::steady_clock::now() - start).count()
+                          / rounds;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "# topic matching, subscriptions: " << num_of_subscriptions << ", seed: " << seed << std::endl
+              << "compile:              " << compile_ms << " ms" << std::endl
+              << "match (cold, trie):   " << cold_ns << " ns" << std::endl
+              << "match (warm, cached): " << warm_ns << " ns" << std::endl
+              << "match (" << topics.size() << " topics, cache of " << TopicCache::kDefaultSlots << "): "
+              << sweep_ns << " ns" << std::endl
+              << "matches per message:  " << (double) matched / (rounds * messages.size()) << std::endl
+              << "match (" << kHashPatternLevels << " \"#\" levels, " << kDeepTopicLevels << "-level topic): "
+              << hash_ns << " ns" << std::endl
+              << "match (same, trie of both patterns): " << hash_trie_ns << " ns"
+              << (hash_errors ? " WRONG RESULTS" : "") << std::endl;
+}
+
+/*
+ * Parses user-defined arguments into an Options struct
+ */
+void SetOptions(int num_of_args, char* arg_vector[], Options& opt)
+{
+    using namespace std;
+
+    // set default parameters
+    opt.delivery = "wait";
+    opt.seconds = 1;
+    opt.seed = 1;
+    opt.batch_size = 1;
+    opt.key_count = 0;
+
+    if (num_of_args > 6)
+    {
+        cout << "usage: " << arg_vector[0] << " [wait|conflate|ring] [seconds] [seed] [batch_size] [keys]" << endl;
+        exit(-1);
+    }
+
+    if (num_of_args > 1)
+    {
+        opt.delivery = arg_vector[1];
+    }
+    if (num_of_args > 2)
+    {
+        opt.seconds = (int) strtod(arg_vector[2], NULL);
+    }
+    if (num_of_args > 3)
+    {
+        opt.seed = (unsigned) strtod(arg_vector[3], NULL);
+    }
+    if (num_of_args > 4)
+    {
+        opt.batch_size = (int) strtod(arg_vector[4], NULL);
+    }
+    if (num_of_args > 5)
+    {
+        opt.key_count = (int) strtod(arg_vector[5], NULL);
+    }
+
+    if (((opt.delivery != "wait") && (opt.delivery != "conflate") && (opt.delivery != "ring")) ||
+        (opt.seconds < 1) || (opt.batch_size < 1) || (opt.key_count < 0))
+    {
+        cout << "usage: " << arg_vector[0] << " [wait|conflate|ring] [seconds] [seed] [batch_size] [keys]" << endl;
+        exit(-1);
+    }
+}
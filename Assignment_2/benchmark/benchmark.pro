@@ -0,0 +1,37 @@
+#-------------------------------------------------
+#
+# Fan-out benchmark for the Publishers-Subscribers demo
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = Assignment_2_benchmark
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+# Boost 1.53 or later (Boost.Atomic)
+INCLUDEPATH += /home/jim/boost_1_53_0 ..
+LIBS += -L/home/jim/boost_1_53_0/stage/lib -lboost_system -lboost_thread -lboost_chrono
+
+SOURCES += benchmark.cpp \
+    ../publisher.cpp \
+    ../subscriber.cpp \
+    ../broadcast_ring.cpp \
+    ../filter_index.cpp \
+    ../topic_trie.cpp
+
+HEADERS += \
+    latency_histogram.h \
+    ../publisher.h \
+    ../subscriber.h \
+    ../message.h \
+    ../broadcast_ring.h \
+    ../rcu_ptr.h \
+    ../filter.h \
+    ../filter_index.h \
+    ../topic_trie.h
@@ -0,0 +1,114 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+#include <algorithm>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+/*
+ * Log-linear latency histogram (HDR style)
+ *  - values below 16 are exact, larger ones fall in 16 linear buckets per power of two
+ *  - relative error is bounded by 1/16, memory is fixed
+ *  - not thread-safe: keep one per thread and merge
+ */
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram() : counts_(kBuckets, 0), count_(0), max_(0) {}
+
+        /*
+         * Records a value
+         */
+        void Record(boost::uint64_t value)
+        {
+            counts_[Bucket(value)]++;
+            count_++;
+            if (value > max_)
+            {
+                max_ = value;
+            }
+        }
+
+        /*
+         * Adds the values recorded by another histogram
+         */
+        void Merge(const LatencyHistogram& other)
+        {
+            for (int i=0; i<kBuckets; i++)
+            {
+                counts_[i] += other.counts_[i];
+            }
+            count_ += other.count_;
+            if (other.max_ > max_)
+            {
+                max_ = other.max_;
+            }
+        }
+
+        /*
+         * Returns the value below which a given percentage of the values fall
+         *  - @percent: from 0 to 100
+         *  - reports the upper bound of the matching bucket (0 if nothing was recorded)
+         */
+        boost::uint64_t Percentile(double percent) const
+        {
+            boost::uint64_t rank = (boost::uint64_t) (percent / 100.0 * count_ + 0.5);
+            boost::uint64_t seen = 0;
+            for (int i=0; i<kBuckets; i++)
+            {
+                seen += counts_[i];
+                if ((seen >= rank) && (seen > 0))
+                {
+                    return std::min(UpperBound(i), max_);
+                }
+            }
+            return max_;
+        }
+
+        boost::uint64_t count() const {return count_;}
+        boost::uint64_t max() const {return max_;}
+
+    private:
+        static const int kSubBits = 4,                         // linear buckets per power of two: 2^4
+                         kSubBuckets = 1 << kSubBits,
+                         kBuckets = kSubBuckets + 60 * kSubBuckets;
+
+        /*
+         * Maps a value onto its bucket
+         */
+        static int Bucket(boost::uint64_t value)
+        {
+            if (value < (boost::uint64_t) kSubBuckets)
+            {
+                return (int) value;
+            }
+
+            // shift the value so that its most significant bit falls on bit kSubBits
+            int shift = 0;
+            while ((value >> shift) >= (boost::uint64_t) (2 * kSubBuckets))
+            {
+                shift++;
+            }
+            return kSubBuckets + shift * kSubBuckets + (int) ((value >> shift) - kSubBuckets);
+        }
+
+        /*
+         * Returns the largest value of a bucket
+         */
+        static boost::uint64_t UpperBound(int bucket)
+        {
+            if (bucket < kSubBuckets)
+            {
+                return bucket;
+            }
+
+            int shift = (bucket - kSubBuckets) / kSubBuckets;
+            boost::uint64_t sub = (bucket - kSubBuckets) % kSubBuckets + kSubBuckets;
+            return ((sub + 1) << shift) - 1;
+        }
+
+        std::vector<boost::uint64_t> counts_;  // values per bucket
+        boost::uint64_t count_,                // values recorded
+                        max_;                  // largest value recorded
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cstring>
+#include "broadcast_ring.h"
+
+const unsigned BroadcastRing::kSlotTextSize;
+const unsigned BroadcastRing::kSlotTopicSize;
+
+/*
+ * Constructor: allocates the slots
+ *  - @capacity: the number of slots
+ *  - @lag_limit: max messages a reader may fall behind (0: never skip, gate on slowest reader)
+ */
+BroadcastRing::BroadcastRing(unsigned capacity, unsigned lag_limit) : capacity_(capacity),
+                                                                      lag_limit_(lag_limit),
+                                                                      slots_(new Slot[capacity]),
+                                                                      next_(0),
+                                                                      published_(0)
+{
+    // a reader can never lag further than a full ring
+    if (lag_limit_ > capacity_)
+    {
+        lag_limit_ = capacity_;
+    }
+
+    for (unsigned i=0; i<capacity_; i++)
+    {
+        slots_[i].sequence.store(0, boost::memory_order_relaxed);
+    }
+}
+
+/*
+ * Destructor: releases the slots and the readers' cursors
+ */
+BroadcastRing::~BroadcastRing()
+{
+    for (unsigned i=0; i<readers_.size(); i++)
+    {
+        delete readers_[i];
+    }
+    delete [] slots_;
+}
+
+/*
+ * Registers a reader, starting at the next message to be published
+ *  - not thread-safe: call before the writer starts publishing
+ */
+int BroadcastRing::AddReader()
+{
+    Reader* reader = new Reader;
+    reader->cursor.store(next_, boost::memory_order_relaxed);
+    reader->dropped.store(0, boost::memory_order_relaxed);
+    readers_.push_back(reader);
+
+    return readers_.size() - 1;
+}
+
+/*
+ * Writes a message into the next slot and makes it visible to all readers
+ *  - single writer only
+ */
+void BroadcastRing::Publish(const Message& msg)
+{
+    Claim(next_);
+    Write(next_, msg);
+
+    next_++;
+    published_.store(next_, boost::memory_order_release);
+}
+
+/*
+ * Writes a batch of messages into the next slots and makes them visible to all readers at once
+ *  - batches larger than the ring are written a ring at a time
+ *  - single writer only
+ */
+void BroadcastRing::PublishBatch(const MessageBatch& batch)
+{
+    for (std::size_t first=0; first<batch.size(); first+=capacity_)
+    {
+        std::size_t count = std::min<std::size_t>(batch.size() - first, capacity_);
+
+        // gate (or skip lagging readers) once for the whole chunk
+        Claim(next_ + count - 1);
+        for (std::size_t i=0; i<count; i++)
+        {
+            Write(next_ + i, batch[first + i]);
+        }
+
+        next_ += count;
+        published_.store(next_, boost::memory_order_release);
+    }
+}
+
+/*
+ * Reads the next message of a reader
+ *  - returns false if the reader is up to date
+ *  - lock-free, to be called by the reader's own thread only
+ */
+bool BroadcastRing::TryRead(int reader, Message& msg)
+{
+    boost::atomic<boost::uint64_t>& cursor = readers_[reader]->cursor;
+
+    while (true)
+    {
+        boost::uint64_t seq = cursor.load(boost::memory_order_acquire);
+        if (seq >= published_.load(boost::memory_order_acquire))
+        {
+            return false;
+        }
+
+        // the slot is being overwritten: the writer is moving this reader forward
+        Slot& slot = slots_[seq % capacity_];
+        if (slot.sequence.load(boost::memory_order_acquire) != seq + 1)
+        {
+            continue;
+        }
+
+        // copy the message, then make sure it was not overwritten meanwhile
+        char text[kSlotTextSize],
+             topic[kSlotTopicSize];
+        unsigned length = std::min(slot.length, kSlotTextSize),
+                 topic_length = std::min(slot.topic_length, kSlotTopicSize);
+        int publisher_id = slot.publisher_id,
+            key = slot.key;
+        double value = slot.value;
+        boost::chrono::steady_clock::time_point published_at = slot.published_at;
+        std::memcpy(text, slot.text, length);
+        std::memcpy(topic, slot.topic, topic_length);
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (slot.sequence.load(boost::memory_order_relaxed) != seq + 1)
+        {
+            continue;
+        }
+
+        // claim the message (fails only if the writer skipped this reader ahead)
+        if (cursor.compare_exchange_strong(seq, seq + 1, boost::memory_order_acq_rel))
+        {
+            msg.publisher_id = publisher_id;
+            msg.key = key;
+            msg.value = value;
+            msg.published_at = published_at;
+            msg.topic.assign(topic, topic_length);
+            msg.text.assign(text, length);
+            return true;
+        }
+    }
+}
+
+
+
+// ----- Private functions -----
+
+/*
+ * Makes the slots up to sequence @last writable
+ *  - gates on the slowest reader, or moves lagging readers forward (lag_limit_ > 0)
+ */
+void BroadcastRing::Claim(boost::uint64_t last)
+{
+    // readers may lag a full ring, or lag_limit_ messages
+    boost::uint64_t window = (lag_limit_ == 0) ? capacity_ : lag_limit_;
+    if (last < window)
+    {
+        return;
+    }
+    boost::uint64_t oldest_kept = last + 1 - window;
+
+    for (unsigned i=0; i<readers_.size(); i++)
+    {
+        boost::uint64_t cursor = readers_[i]->cursor.load(boost::memory_order_acquire);
+
+        // wait for the slowest reader
+        if (lag_limit_ == 0)
+        {
+            while (cursor < oldest_kept)
+            {
+                boost::this_thread::yield();
+                cursor = readers_[i]->cursor.load(boost::memory_order_acquire);
+            }
+        }
+
+        // move a lagging reader forward (it may be moving itself concurrently)
+        else
+        {
+            while ((cursor < oldest_kept) &&
+                   !readers_[i]->cursor.compare_exchange_weak(cursor, oldest_kept,
+                                                              boost::memory_order_acq_rel))
+            {
+            }
+
+            if (cursor < oldest_kept)
+            {
+                readers_[i]->dropped.fetch_add(oldest_kept - cursor, boost::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/*
+ * Writes a message into the slot of sequence @seq (not yet visible to readers)
+ */
+void BroadcastRing::Write(boost::uint64_t seq, const Message& msg)
+{
+    // sequence 0 marks the slot as being written
+    Slot& slot = slots_[seq % capacity_];
+    slot.sequence.store(0, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+
+    slot.publisher_id = msg.publisher_id;
+    slot.key = msg.key;
+    slot.value = msg.value;
+    slot.published_at = msg.published_at;
+    slot.length = std::min<std::size_t>(msg.text.size(), kSlotTextSize);
+    std::memcpy(slot.text, msg.text.data(), slot.length);
+    slot.topic_length = std::min<std::size_t>(msg.topic.size(), kSlotTopicSize);
+    std::memcpy(slot.topic, msg.topic.data(), slot.topic_length);
+
+    slot.sequence.store(seq + 1, boost::memory_order_release);
+}
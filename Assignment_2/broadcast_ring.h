@@ -0,0 +1,70 @@
+#ifndef BROADCAST_RING_H
+#define BROADCAST_RING_H
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include "message.h"
+
+/*
+ * Pre-allocated broadcast ring buffer (disruptor style)
+ *  - one writer (the owning publisher's thread), many readers
+ *  - every message is written once, each reader follows it with its own sequence (cursor)
+ *  - lag_limit == 0: the writer waits for the slowest reader (no message is lost)
+ *  - lag_limit  > 0: the writer never waits, readers lagging further behind skip ahead
+ *  - readers must be added before publishing starts
+ *  - slots carry the message key, value and topic, so readers can filter
+ *  - message texts longer than kSlotTextSize (topics: kSlotTopicSize) are truncated
+ */
+class BroadcastRing : private boost::noncopyable
+{
+    public:
+        static const unsigned kSlotTextSize = 112,
+                              kSlotTopicSize = 64;
+
+        BroadcastRing(unsigned capacity, unsigned lag_limit);
+        ~BroadcastRing();
+
+        int AddReader();                          // registers a reader, returns its index
+        void Publish(const Message& msg);         // writes a message (writer thread only)
+        void PublishBatch(const MessageBatch& batch);  // writes messages, gating once per batch (writer only)
+        bool TryRead(int reader, Message& msg);   // reads the reader's next message, if any (lock-free)
+        boost::uint64_t dropped(int reader) {return readers_[reader]->dropped.load(boost::memory_order_relaxed);}
+
+    private:
+        void Claim(boost::uint64_t last);                 // makes slots up to sequence last writable
+        void Write(boost::uint64_t seq, const Message& msg);  // fills the slot of a sequence
+
+        // a message slot, guarded by its sequence (0 while being written, sequence + 1 when complete)
+        struct Slot
+        {
+            boost::atomic<boost::uint64_t> sequence;
+            int publisher_id,
+                key;
+            double value;
+            boost::chrono::steady_clock::time_point published_at;
+            unsigned length,
+                     topic_length;
+            char text[kSlotTextSize],
+                 topic[kSlotTopicSize];
+        };
+
+        // a reader's cursor, padded to keep readers off each other's cache lines
+        struct Reader
+        {
+            boost::atomic<boost::uint64_t> cursor,   // next sequence to read
+                                           dropped;  // messages skipped due to the lag limit
+            char padding[64 - 2 * sizeof(boost::uint64_t)];
+        };
+
+        unsigned capacity_,   // number of slots
+                 lag_limit_;  // max messages a reader may fall behind (0: gate on slowest reader)
+        Slot* slots_;                                  // the ring
+        std::vector<Reader*> readers_;                 // readers' cursors
+        boost::uint64_t next_;                         // next sequence to write (writer only)
+        char padding_[64 - sizeof(boost::uint64_t)];   // keeps published_ off the writer's line
+        boost::atomic<boost::uint64_t> published_;     // sequences below this are readable
+};
+
+#endif // BROADCAST_RING_H
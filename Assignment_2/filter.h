@@ -0,0 +1,45 @@
+#ifndef FILTER_H
+#define FILTER_H
+#include <limits>
+#include <set>
+#include <vector>
+#include "message.h"
+#include "topic_trie.h"
+
+/*
+ * Content filter registered by a subscriber, evaluated by the publisher before dispatch
+ *  - key set: the message key must be one of keys (empty: any key, one key: equality)
+ *  - value range: the message value must fall in [min_value, max_value]
+ *  - topic patterns: the message topic must match one of topics (empty: any topic)
+ */
+struct Filter
+{
+    Filter() : min_value(-std::numeric_limits<double>::max()),
+               max_value(std::numeric_limits<double>::max()) {}
+
+    Filter& AddKey(int key) {keys.insert(key); return *this;}
+    Filter& SetValueRange(double min, double max) {min_value = min; max_value = max; return *this;}
+    Filter& AddTopic(const std::string& pattern) {topics.push_back(pattern); return *this;}
+
+    bool HasRange() const {return (min_value > -std::numeric_limits<double>::max()) ||
+                                  (max_value < std::numeric_limits<double>::max());}
+
+    // reference evaluation (the publisher uses the compiled FilterIndex)
+    bool Matches(const Message& msg) const
+    {
+        bool is_topic_match = topics.empty();
+        for (unsigned i=0; (i<topics.size()) && !is_topic_match; i++)
+        {
+            is_topic_match = TopicMatches(topics[i], msg.topic);
+        }
+        return is_topic_match && (keys.empty() || keys.count(msg.key)) &&
+               (msg.value >= min_value) && (msg.value <= max_value);
+    }
+
+    std::set<int> keys;  // accepted keys
+    double min_value,    // accepted value range
+           max_value;
+    std::vector<std::string> topics;  // accepted topic patterns ("eq.us.*", "eq.#")
+};
+
+#endif // FILTER_H
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <iterator>
+#include <boost/functional/hash.hpp>
+#include "filter_index.h"
+
+/*
+ * Compiles the subscribers' filters
+ *  - @filters: one filter per subscriber, in subscriber order
+ */
+void FilterIndex::Compile(const std::vector<Filter>& filters)
+{
+    std::size_t count = filters.size();
+
+    by_key_.clear();
+    any_key_list_.clear();
+    any_key_.clear();
+    any_key_.resize(count);
+    ranged_.clear();
+    ranged_.resize(count);
+    min_values_.resize(count);
+    max_values_.resize(count);
+    topics_.Clear();
+    topic_cache_.reset();
+    is_unconditional_ = true;
+    is_ranged_ = false;
+    uses_topics_ = false;
+    uses_contents_ = false;
+
+    for (std::size_t i=0; i<count; i++)
+    {
+        const Filter& filter = filters[i];
+
+        // key set: add the subscriber to the list of each key it lists (subscriber order: sorted)
+        if (filter.keys.empty())
+        {
+            any_key_.set(i);
+            any_key_list_.push_back(i);
+        }
+        else
+        {
+            for (std::set<int>::const_iterator key = filter.keys.begin(); key != filter.keys.end(); ++key)
+            {
+                by_key_[*key].push_back(i);
+            }
+            is_unconditional_ = false;
+            uses_contents_ = true;
+        }
+
+        // value range: checked only for the candidates
+        if (filter.HasRange())
+        {
+            ranged_.set(i);
+            is_ranged_ = true;
+            is_unconditional_ = false;
+            uses_contents_ = true;
+        }
+        min_values_[i] = filter.min_value;
+        max_values_[i] = filter.max_value;
+
+        if (!filter.topics.empty())
+        {
+            uses_topics_ = true;
+        }
+    }
+
+    // topic patterns: once anybody uses them, everybody goes in the trie ("#": any topic)
+    if (uses_topics_)
+    {
+        is_unconditional_ = false;
+        for (std::size_t i=0; i<count; i++)
+        {
+            if (filters[i].topics.empty())
+            {
+                topics_.Insert("#", i);
+            }
+            for (unsigned t=0; t<filters[i].topics.size(); t++)
+            {
+                topics_.Insert(filters[i].topics[t], i);
+            }
+        }
+        topic_cache_.reset(new TopicCache);
+    }
+}
+
+/*
+ * Selects the subscribers whose filter accepts a message
+ *  - returns the indices of the matching subscribers (in increasing order)
+ *  - the result is either a cached topic match held in @scratch (no copy), or written to @scratch
+ *  - lock-free (but for the topic cache's slot spinlocks)
+ */
+const std::vector<unsigned>& FilterIndex::Match(const Message& msg, Scratch& scratch) const
+{
+    scratch.subscribers.clear();
+
+    boost::unordered_map<int, std::vector<unsigned> >::const_iterator it = by_key_.find(msg.key);
+    const std::vector<unsigned>* key_subscribers = (it != by_key_.end()) ? &it->second : NULL;
+
+    // topic candidates: from the cache, or matched in the trie (then cached)
+    if (uses_topics_)
+    {
+        std::size_t hash = boost::hash<std::string>()(msg.topic);
+        scratch.entry = topic_cache_->Find(msg.topic, hash);
+        if (!scratch.entry)
+        {
+            boost::shared_ptr<TopicCache::Entry> fresh(new TopicCache::Entry);
+            fresh->topic = msg.topic;
+            topics_.Match(msg.topic, fresh->subscribers);
+            topic_cache_->Insert(fresh, hash);
+            scratch.entry = fresh;
+        }
+
+        // topics only: the cached match is the result
+        const std::vector<unsigned>& candidates = scratch.entry->subscribers;
+        if (!uses_contents_)
+        {
+            return candidates;
+        }
+
+        for (unsigned i=0; i<candidates.size(); i++)
+        {
+            if (Accepts(candidates[i], msg, key_subscribers))
+            {
+                scratch.subscribers.push_back(candidates[i]);
+            }
+        }
+        return scratch.subscribers;
+    }
+
+    // key candidates: the subscribers accepting any key, merged with those listing the key (if any)
+    const std::vector<unsigned>* candidates = &any_key_list_;
+    if (key_subscribers != NULL)
+    {
+        if (any_key_list_.empty())
+        {
+            candidates = key_subscribers;
+        }
+        else
+        {
+            std::set_union(any_key_list_.begin(), any_key_list_.end(),
+                           key_subscribers->begin(), key_subscribers->end(),
+                           std::back_inserter(scratch.subscribers));
+            candidates = &scratch.subscribers;
+        }
+    }
+
+    // nobody filters on values: the candidates are the result
+    if (!is_ranged_)
+    {
+        return *candidates;
+    }
+
+    // drop candidates whose range rejects the value (in place if already copied)
+    std::vector<unsigned>::iterator kept = scratch.subscribers.begin();
+    for (unsigned i=0; i<candidates->size(); i++)
+    {
+        unsigned subscriber = (*candidates)[i];
+        if (!InRange(subscriber, msg.value))
+        {
+            continue;
+        }
+
+        if (candidates == &scratch.subscribers)
+        {
+            *kept++ = subscriber;
+        }
+        else
+        {
+            scratch.subscribers.push_back(subscriber);
+        }
+    }
+    if (candidates == &scratch.subscribers)
+    {
+        scratch.subscribers.erase(kept, scratch.subscribers.end());
+    }
+    return scratch.subscribers;
+}
+
+/*
+ * Checks a subscriber's key set and value range
+ *  - @key_subscribers: the subscribers listing the message key (NULL: none)
+ */
+bool FilterIndex::Accepts(unsigned subscriber, const Message& msg,
+                          const std::vector<unsigned>* key_subscribers) const
+{
+    if (!any_key_.test(subscriber) &&
+        ((key_subscribers == NULL) ||
+         !std::binary_search(key_subscribers->begin(), key_subscribers->end(), subscriber)))
+    {
+        return false;
+    }
+
+    return InRange(subscriber, msg.value);
+}
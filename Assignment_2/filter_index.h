@@ -0,0 +1,57 @@
+#ifndef FILTER_INDEX_H
+#define FILTER_INDEX_H
+#include <vector>
+#include <boost/dynamic_bitset.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include "filter.h"
+#include "message.h"
+#include "topic_trie.h"
+
+/*
+ * Subscribers' filters compiled into sorted index lists, bitsets and a topic trie (subscriber i: bit/index i)
+ *  - a message key selects its candidates with one hash lookup and (at most) one merge of two lists
+ *  - a message topic selects its candidates with one (cached) trie match
+ *  - only the candidates are then checked one by one (if anybody filters on keys or values)
+ *  - immutable once compiled (but for the topic cache)
+ *  - the topic cache is allocated by Compile, only if anybody filters on topics
+ *    (a copy shares it: same trie, same results, until recompiled)
+ */
+class FilterIndex
+{
+    public:
+        // a matching thread's working space, reused from one message to the next
+        struct Scratch
+        {
+            std::vector<unsigned> subscribers;  // matches (unless returned straight from the cache)
+            TopicCache::EntryPtr entry;         // the message topic's cached match (kept alive if evicted)
+        };
+
+        FilterIndex() : is_unconditional_(true), is_ranged_(false), uses_topics_(false), uses_contents_(false) {}
+
+        void Compile(const std::vector<Filter>& filters);  // rebuilds the index
+        const std::vector<unsigned>& Match(const Message& msg,
+                                           Scratch& scratch) const;  // selects the matching subscribers
+        bool is_unconditional() const {return is_unconditional_;}  // true if nobody filters anything
+
+    private:
+        bool Accepts(unsigned subscriber, const Message& msg,
+                     const std::vector<unsigned>* key_subscribers) const;  // key and value checks
+        bool InRange(unsigned subscriber, double value) const {return !ranged_.test(subscriber) ||
+                        ((value >= min_values_[subscriber]) && (value <= max_values_[subscriber]));}
+
+        boost::unordered_map<int, std::vector<unsigned> > by_key_;    // subscribers listing each key (sorted)
+        std::vector<unsigned> any_key_list_;                          // subscribers accepting any key (sorted)
+        boost::dynamic_bitset<> any_key_,                             // subscribers accepting any key
+                                ranged_;                              // subscribers with a value range
+        std::vector<double> min_values_,                              // value ranges (per subscriber)
+                            max_values_;
+        TopicTrie topics_;                                            // subscribers' topic patterns
+        boost::shared_ptr<TopicCache> topic_cache_;                   // topic match results (NULL: no topics)
+        bool is_unconditional_,
+             is_ranged_,                                              // true if anybody filters on values
+             uses_topics_,                                            // true if anybody filters on topics
+             uses_contents_;                                          // true if anybody filters on keys/values
+};
+
+#endif // FILTER_INDEX_H
@@ -1,21 +1,29 @@
 #include <boost/thread.hpp>
-#include <boost/signals2.hpp>
 #include "publisher.h"
 #include "subscriber.h"
 
 /* ---------------------------------------------------------------------------------------------
  * Publishers-Subscribers demo
  * ---------------------------------------------------------------------------------------------
- * Usage: takes 2 arguements (or none -> default) as follows
+ * Usage: takes 2 to 4 arguements (or none -> default) as follows
  *
  *               1st arguement: number of publisher threads
  *               2nd arguement: number of subscriber threads
+ *               3rd arguement: delivery mode (optional)
+ *                                "wait"     -> publishers wait for slow subscribers
+ *                                "conflate" -> subscribers keep the latest message per publisher
+ *                                "ring"     -> publishers write once to a broadcast ring buffer
+ *               4th arguement: ring lag limit in messages (optional, "ring" mode only)
+ *                                0 -> publishers wait for the slowest subscriber
  * ---------------------------------------------------------------------------------------------
  * Default options:
  *                    publishers: [ 5] threads
  *                   subscribers: [15] threads
+ *                 delivery mode: [wait]
+ *                ring lag limit: [0] messages
  * ---------------------------------------------------------------------------------------------
  * NOTE : programme runs INFINATE LOOPS, manually kill to exit)
+ *        subscriptions are moved around at run time (except in "ring" mode)
  * ---------------------------------------------------------------------------------------------
  * Author: Dimitris Saliaris
  * Date:   Feb 24th, 2013
@@ -24,10 +32,13 @@
 /*
  * Structure that holds user-defined options
  */
-struct Options { int num_of_pubs, num_of_subs;};
+struct Options { int num_of_pubs, num_of_subs, ring_lag_limit; std::string delivery;};
+
+const unsigned kRingCapacity = 1024;  // slots per publisher ring ("ring" mode)
 
 void SetOptions(int num_of_args, char* arg_vector[], Options& opt);
 void ShowOptions(Options* p_opt);
+void ChurnSubscriptions(Publisher* pubs, int num_of_pub, Subscriber* subs, int num_of_sub);
 
 /*
  * Main function
@@ -49,6 +60,10 @@ int main(int argc, char* argv[])
     for (int i=0; i<num_of_pub; i++)
     {
         pubs[i].set_id(i+1);
+        if (options.delivery == "ring")
+        {
+            pubs[i].EnableRing(kRingCapacity, options.ring_lag_limit);
+        }
     }
 
     // create subscribers and set their id
@@ -56,6 +71,7 @@ int main(int argc, char* argv[])
     for (int i=0; i<num_of_sub; i++)
     {
         subs[i].set_id(i+1);
+        subs[i].set_conflate(options.delivery == "conflate");
     }
 
     // initialise some utility variables for random shuffling and selection
@@ -77,8 +93,15 @@ int main(int argc, char* argv[])
         std::random_shuffle(indices, indices+num_of_pub);
         for (int j=0; j<num_of_con; j++)
         {
-            // connect the (i-th) subscriber with the (j-th) publisher and register the connection
-            subs[i].AddConnection(pubs[indices[j]].AddSubscriber(subs[i]));
+            // connect the (i-th) subscriber with the (j-th) publisher
+            if (options.delivery == "ring")
+            {
+                pubs[indices[j]].AddReader(subs[i]);
+            }
+            else
+            {
+                subs[i].Subscribe(pubs[indices[j]]);
+            }
         }
     }
 
@@ -94,13 +117,56 @@ int main(int argc, char* argv[])
     // create and launch sub threads
     for (int i=0; i<num_of_sub; i++)
     {
-        threads.create_thread(boost::bind(&Subscriber::DisplayMessage, &subs[i]));
+        if (options.delivery == "ring")
+        {
+            threads.create_thread(boost::bind(&Subscriber::ReadRings, &subs[i]));
+        }
+        else
+        {
+            threads.create_thread(boost::bind(&Subscriber::DisplayMessage, &subs[i]));
+        }
+    }
+
+    // create and launch a thread that moves subscriptions while publishing goes on
+    if (options.delivery != "ring")
+    {
+        threads.create_thread(boost::bind(&ChurnSubscriptions, pubs, num_of_pub, subs, num_of_sub));
     }
 
     threads.join_all();
     return 0;
 }
 
+/*
+ * Moves a random subscriber from one of its publishers to a random publisher, once a second
+ *  - runs an infinate loop
+ *  - publishers keep publishing meanwhile (they are never blocked)
+ */
+void ChurnSubscriptions(Publisher* pubs, int num_of_pub, Subscriber* subs, int num_of_sub)
+{
+    while(true) // infinate loop
+    {
+        sleep(1);
+
+        // pick a subscriber and one of its publishers
+        Subscriber& sub = subs[rand() % num_of_sub];
+        std::vector<Publisher*> current = sub.publishers();
+        if (current.empty())
+        {
+            continue;
+        }
+        Publisher* from = current[rand() % current.size()];
+        Publisher* to = &pubs[rand() % num_of_pub];
+
+        // move the subscription
+        sub.Unsubscribe(*from);
+        sub.Subscribe(*to);
+
+        std::cout << " ~~ Subscription moved from Pub " << (from - pubs) + 1
+                  << " to Pub " << (to - pubs) + 1 << std::endl;
+    }
+}
+
 /*
  * Parses user-defined arguments into an Options struct
  */
@@ -111,6 +177,8 @@ void SetOptions(int num_of_args, char* arg_vector[], Options& opt)
     // set default parameters
     opt.num_of_pubs = 5;
     opt.num_of_subs = 15;
+    opt.delivery = "wait";
+    opt.ring_lag_limit = 0;
 
     switch (num_of_args)
     {
@@ -142,6 +210,24 @@ void SetOptions(int num_of_args, char* arg_vector[], Options& opt)
         exit(-1);
         }
 
+    // 4 arguements passed (ring lag limit selected)
+    case 5:
+        opt.ring_lag_limit = (int) strtod(arg_vector[4], NULL);
+        // fall through - parse the delivery mode too
+
+    // 3 arguements passed (delivery mode selected)
+    case 4:
+        opt.delivery = arg_vector[3];
+        if ((opt.delivery != "wait") && (opt.delivery != "conflate") && (opt.delivery != "ring"))
+        {
+            cout << "\n *** Unknown delivery mode: Programme is being terminated... *** \n" << endl;
+
+            // wait 2 seconds for the exit message to be read
+            sleep(2);
+            exit(-1);
+        }
+        // fall through - parse the thread counts too
+
     // 2 arguements passed (proper usage)
     case 3:  // TODO: check and validate...
     {
@@ -170,7 +256,9 @@ void ShowOptions(Options* p_opt)
     using namespace std;
 
     cout << "\t   Number of publishers: " << p_opt->num_of_pubs << " threads" << endl
-         << "\t  Number of subscribers: " << p_opt->num_of_subs << " threads \n" << endl;
+         << "\t  Number of subscribers: " << p_opt->num_of_subs << " threads" << endl
+         << "\t          Delivery mode: " << p_opt->delivery << endl
+         << "\t         Ring lag limit: " << p_opt->ring_lag_limit << " messages \n" << endl;
 
     // wait 2 seconds for the display to be read
     sleep(2);
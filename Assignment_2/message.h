@@ -0,0 +1,22 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+#include <string>
+#include <vector>
+#include <boost/chrono.hpp>
+
+/*
+ * Message passed from publishers to subscribers
+ */
+struct Message
+{
+    int publisher_id;  // id_ of the emitting publisher (key for last-value caching)
+    std::string topic; // hierarchical topic, e.g. "eq.us.AAPL" (levels separated by '.')
+    int key;           // content key (e.g. an instrument), used by filters
+    double value;      // content value (e.g. a price), used by filters
+    std::string text;  // message body
+    boost::chrono::steady_clock::time_point published_at;  // publishing time (for latency measurements)
+};
+
+typedef std::vector<Message> MessageBatch;  // messages delivered as a unit
+
+#endif // MESSAGE_H
@@ -1,38 +1,231 @@
+#include <algorithm>
+#include <boost/random/linear_congruential.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
 #include "publisher.h"
 
 /*
- * Connects a subscriber's slot to the publisher's signal
+ * Inserts a subscriber into a copy of the subscriber list (if not already there), recompiles filters
  */
-boost::signals2::connection Publisher::AddSubscriber(Subscriber& sub)
+static bool InsertSubscriber(Publisher::SubscriberList& list, Subscriber* sub, const Filter& filter)
 {
-    return signal_.connect(boost::bind(&Subscriber::set_message, &sub, _1));
+    if (std::find(list.subscribers.begin(), list.subscribers.end(), sub) != list.subscribers.end())
+    {
+        return false;
+    }
+
+    list.subscribers.push_back(sub);
+    list.filters.push_back(filter);
+    list.index.Compile(list.filters);
+    return true;
+}
+
+/*
+ * Erases a subscriber from a copy of the subscriber list (if there), recompiles filters
+ */
+static bool EraseSubscriber(Publisher::SubscriberList& list, Subscriber* sub)
+{
+    std::vector<Subscriber*>::iterator it = std::find(list.subscribers.begin(), list.subscribers.end(), sub);
+    if (it == list.subscribers.end())
+    {
+        return false;
+    }
+
+    list.filters.erase(list.filters.begin() + (it - list.subscribers.begin()));
+    list.subscribers.erase(it);
+    list.index.Compile(list.filters);
+    return true;
+}
+
+/*
+ * Adds a subscriber to the publisher's subscriber list
+ *  - @filter: what the subscriber wants (default: everything), evaluated by the publisher
+ *  - can be called while publishing: the publishing thread is never blocked
+ *  - returns false if the subscriber is already subscribed, or if the publisher uses a ring
+ *    (ring readers are registered with AddReader, the subscriber list would never be published to)
+ */
+bool Publisher::AddSubscriber(Subscriber& sub, const Filter& filter)
+{
+    if (ring_)
+    {
+        return false;
+    }
+
+    return subscribers_.Update(boost::bind(&InsertSubscriber, _1, &sub, filter));
 }
 
 /*
- * Sends a string message to all connected subscribers
+ * Removes a subscriber from the publisher's subscriber list
+ *  - can be called while publishing: the publishing thread is never blocked
+ *  - returns once no publishing can reach the subscriber anymore (it can then be safely destroyed)
+ *  - returns false if the subscriber was not subscribed
+ */
+bool Publisher::RemoveSubscriber(Subscriber& sub)
+{
+    return subscribers_.Update(boost::bind(&EraseSubscriber, _1, &sub));
+}
+
+/*
+ * Switches the publisher to the broadcast ring transport
+ *  - @capacity: the number of pre-allocated ring slots
+ *  - @lag_limit: max messages a reader may fall behind (0: wait for the slowest reader)
+ */
+void Publisher::EnableRing(unsigned capacity, unsigned lag_limit)
+{
+    ring_.reset(new BroadcastRing(capacity, lag_limit));
+}
+
+/*
+ * Registers a subscriber as a reader of the publisher's ring
+ *  - @filter: the messages wanted (default: all), checked by the reader (every message is written once)
+ *  - call before the publisher starts publishing
+ */
+void Publisher::AddReader(Subscriber& sub, const Filter& filter)
+{
+    sub.AddRing(ring_, ring_->AddReader(), filter);
+}
+
+/*
+ * Sends a message to all current subscribers
+ *  - writes it once to the ring (readers filter), or hands it to each subscriber whose filter accepts it
+ */
+void Publisher::Publish(const Message& msg)
+{
+    if (ring_)
+    {
+        ring_->Publish(msg);
+    }
+    else
+    {
+        RcuPtr<SubscriberList>::ReadGuard list(subscribers_);
+        const std::vector<Subscriber*>& subscribers = list->subscribers;
+
+        // nobody filters: deliver to all
+        if (list->index.is_unconditional())
+        {
+            for (unsigned i=0; i<subscribers.size(); i++)
+            {
+                subscribers[i]->set_message(msg);
+            }
+        }
+
+        // deliver to the subscribers selected by the compiled filters only
+        else
+        {
+            const std::vector<unsigned>& matches = list->index.Match(msg, match_scratch_);
+            for (unsigned i=0; i<matches.size(); i++)
+            {
+                subscribers[matches[i]]->set_message(msg);
+            }
+        }
+    }
+    published_++;
+}
+
+/*
+ * Sends a batch of messages to all current subscribers in one dispatch
+ *  - each subscriber gets the (filtered) batch at once (one lock, one wake-up)
+ */
+void Publisher::PublishBatch(const MessageBatch& batch)
+{
+    if (ring_)
+    {
+        ring_->PublishBatch(batch);
+    }
+    else
+    {
+        RcuPtr<SubscriberList>::ReadGuard list(subscribers_);
+        const std::vector<Subscriber*>& subscribers = list->subscribers;
+
+        // nobody filters: deliver the whole batch to all
+        if (list->index.is_unconditional())
+        {
+            for (unsigned i=0; i<subscribers.size(); i++)
+            {
+                subscribers[i]->set_batch(batch);
+            }
+        }
+
+        // split the batch by subscriber, then deliver the non-empty parts
+        else
+        {
+            std::vector<MessageBatch> filtered(subscribers.size());
+            for (unsigned m=0; m<batch.size(); m++)
+            {
+                const std::vector<unsigned>& matches = list->index.Match(batch[m], match_scratch_);
+                for (unsigned i=0; i<matches.size(); i++)
+                {
+                    filtered[matches[i]].push_back(batch[m]);
+                }
+            }
+
+            for (unsigned i=0; i<subscribers.size(); i++)
+            {
+                if (!filtered[i].empty())
+                {
+                    subscribers[i]->set_batch(filtered[i]);
+                }
+            }
+        }
+    }
+    published_ += batch.size();
+}
+
+/*
+ * Sends string messages to all connected subscribers
+ *  - sends batch_size_ messages at a time
+ *  - loops until stopped
  */
 void Publisher::PublishData()
 {
-    // initialise the sleep duration
-    std::string message("");
+    // initialise the message (batch), its content generator and the sleep duration
+    Message message;
+    message.publisher_id = id_;
+    MessageBatch batch;
+    boost::random::minstd_rand generator(id_);
+    boost::random::uniform_int_distribution<> values(0, 99);
+    std::string topic_prefix = "pub." + boost::lexical_cast<std::string>(id_) + ".";
+    unsigned long sequence = 0;
     int sleep_duration = 0;
 
-    do // infinate loop
+    while (running_)
     {
-        message.append("From Pub ");
-        message.append(boost::lexical_cast<std::string>(id_));
-        message.append(" [thr_ID: ");
-        message.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
-        message.append("] ");
-        signal_(message);
+        for (int i=0; i<batch_size_; i++)
+        {
+            message.text.append("From Pub ");
+            message.text.append(boost::lexical_cast<std::string>(id_));
+            message.text.append(" [thr_ID: ");
+            message.text.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
+            message.text.append("] ");
+            message.key = sequence++ % key_count_;
+            message.topic = topic_prefix + boost::lexical_cast<std::string>(message.key);  // "pub.<id>.<key>"
+            message.value = values(generator);
+            message.published_at = boost::chrono::steady_clock::now();
+
+            if (batch_size_ > 1)
+            {
+                batch.push_back(message);
+            }
+            else
+            {
+                Publish(message);
+            }
+
+            // clear message
+            message.text.assign("");
+        }
 
-        // clear message
-        message.assign("");
+        if (batch_size_ > 1)
+        {
+            PublishBatch(batch);
+            batch.clear();
+        }
 
         // sleep so as to simulate random message emission (range: from 0.1 to 0.9 seconds)
-        srand(time(NULL));  // random seed initialisation
-        sleep_duration = (rand() % 9 + 1) * 100000;
-        usleep(sleep_duration);
+        if (is_throttled_)
+        {
+            srand(time(NULL));  // random seed initialisation
+            sleep_duration = (rand() % 9 + 1) * 100000;
+            usleep(sleep_duration);
+        }
     }
-    while (true);
 }
@@ -1,8 +1,12 @@
 #ifndef PUBLISHER_H
 #define PUBLISHER_H
-#include <boost/signals2.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
+#include "broadcast_ring.h"
+#include "filter.h"
+#include "filter_index.h"
+#include "message.h"
+#include "rcu_ptr.h"
 #include "subscriber.h"
 
 /*
@@ -11,14 +15,41 @@
 class Publisher
 {
     public:
-        Publisher(){}
+        // subscriber list, with the subscribers' filters compiled (immutable once published)
+        struct SubscriberList
+        {
+            std::vector<Subscriber*> subscribers;
+            std::vector<Filter> filters;  // one per subscriber
+            FilterIndex index;            // compiled filters
+        };
+
+        Publisher() : running_(true), is_throttled_(true), batch_size_(1), key_count_(1), published_(0) {}
         void set_id(int id) {id_ = id;}
-        boost::signals2::connection AddSubscriber(Subscriber& sub);  // connects subscriber slot to signal_
-        void PublishData();                                          // sends a string to subscribers
+        void set_throttled(bool throttled) {is_throttled_ = throttled;}  // false: publishes without sleeping
+        void set_batch_size(int size) {batch_size_ = size;}              // messages per PublishData dispatch
+        void set_key_count(int count) {key_count_ = count;}              // keys cycled through by PublishData
+        unsigned long published() {return published_;}                  // messages published so far
+        void Stop() {running_ = false;}                                  // makes PublishData return
+        bool AddSubscriber(Subscriber& sub,
+                           const Filter& filter = Filter());         // adds subscriber, even while publishing
+        bool RemoveSubscriber(Subscriber& sub);                      // removes subscriber, even while publishing
+        void EnableRing(unsigned capacity, unsigned lag_limit);      // publishes through a broadcast ring instead
+        void AddReader(Subscriber& sub,
+                       const Filter& filter = Filter());             // registers subscriber as a ring reader
+        void Publish(const Message& msg);                            // sends a message to subscribers
+        void PublishBatch(const MessageBatch& batch);                // sends messages in a single dispatch
+        void PublishData();                                          // sends strings to subscribers (loops)
 
     private:
-        boost::signals2::signal<void (std::string)> signal_;  // signal used for publishing to subscribers
-        int id_;                                              // publisher's identifier
+        RcuPtr<SubscriberList> subscribers_;              // subscribers (copy-on-write, lock-free for publishing)
+        boost::shared_ptr<BroadcastRing> ring_;           // broadcast ring (ring transport only)
+        FilterIndex::Scratch match_scratch_;              // filter matching space (publishing thread only)
+        boost::atomic<bool> running_;                     // flag for publishing to go on
+        bool is_throttled_;                               // flag for sleeping between messages
+        int batch_size_,                                  // messages per dispatch in PublishData
+            key_count_;                                   // message keys used in PublishData
+        unsigned long published_;                         // messages published (by the publishing thread)
+        int id_;                                          // publisher's identifier
 };
 
 #endif // PUBLISHER_H
@@ -0,0 +1,100 @@
+#ifndef RCU_PTR_H
+#define RCU_PTR_H
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+/*
+ * Read-copy-update pointer to an immutable object
+ *  - readers never lock: a ReadGuard pins the current epoch and loads the object
+ *  - writers are serialised, modify a private copy and swap it in
+ *  - the old copy is deleted once every reader that could have loaded it is gone
+ */
+template <typename T>
+class RcuPtr : private boost::noncopyable
+{
+    public:
+        /*
+         * Pins the object for reading (lock-free)
+         */
+        class ReadGuard : private boost::noncopyable
+        {
+            public:
+                explicit ReadGuard(RcuPtr& rcu) : rcu_(rcu)
+                {
+                    // count this reader in the current epoch (retry if a writer flips it meanwhile)
+                    while (true)
+                    {
+                        epoch_ = rcu_.epoch_.load();
+                        rcu_.readers_[epoch_ & 1].value.fetch_add(1);
+                        if (rcu_.epoch_.load() == epoch_)
+                        {
+                            break;
+                        }
+                        rcu_.readers_[epoch_ & 1].value.fetch_sub(1);
+                    }
+                    object_ = rcu_.object_.load();
+                }
+                ~ReadGuard() {rcu_.readers_[epoch_ & 1].value.fetch_sub(1, boost::memory_order_release);}
+
+                const T& operator*() const {return *object_;}
+                const T* operator->() const {return object_;}
+
+            private:
+                RcuPtr& rcu_;
+                unsigned epoch_;
+                const T* object_;
+        };
+
+        RcuPtr() : object_(new T), epoch_(0)
+        {
+            readers_[0].value.store(0);
+            readers_[1].value.store(0);
+        }
+        ~RcuPtr() {delete object_.load();}
+
+        /*
+         * Applies a modification to a copy of the object and publishes it
+         *  - @modify: a functor taking a T&, returns true if the copy should replace the object
+         *  - waits for the readers of the old copy before deleting it (never blocks readers)
+         */
+        template <typename Modifier>
+        bool Update(Modifier modify)
+        {
+            boost::mutex::scoped_lock update_lock(update_mutex_);
+
+            const T* old_object = object_.load();
+            T* new_object = new T(*old_object);
+            if (!modify(*new_object))
+            {
+                delete new_object;
+                return false;
+            }
+            object_.store(new_object);
+
+            // move new readers to the next epoch, then wait for those of the previous one
+            unsigned epoch = epoch_.fetch_add(1);
+            while (readers_[epoch & 1].value.load(boost::memory_order_acquire) != 0)
+            {
+                boost::this_thread::yield();
+            }
+
+            delete old_object;
+            return true;
+        }
+
+    private:
+        // reader counter, padded to its own cache line
+        struct Counter
+        {
+            boost::atomic<int> value;
+            char padding[64 - sizeof(boost::atomic<int>)];
+        };
+
+        boost::atomic<const T*> object_;  // current (immutable) copy
+        boost::atomic<unsigned> epoch_;   // its parity selects the readers' counter
+        Counter readers_[2];              // readers pinned in even/odd epochs
+        boost::mutex update_mutex_;       // serialises writers
+};
+
+#endif // RCU_PTR_H
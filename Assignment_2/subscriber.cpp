@@ -1,57 +1,257 @@
+#include <algorithm>
+#include "publisher.h"
 #include "subscriber.h"
 
+/*
+ * Subscribes to a publisher
+ *  - @filter: the messages wanted (default: all), the publisher drops the rest before dispatch
+ *  - can be called while the publisher is publishing
+ *  - returns false if already subscribed
+ */
+bool Subscriber::Subscribe(Publisher& pub, const Filter& filter)
+{
+    boost::mutex::scoped_lock connection_lock(connection_mutex_);
+
+    if (!pub.AddSubscriber(*this, filter))
+    {
+        return false;
+    }
+
+    publishers_.push_back(&pub);
+    return true;
+}
+
+/*
+ * Unsubscribes from a publisher
+ *  - can be called while the publisher is publishing
+ *  - on return, the publisher will not deliver any more messages to this subscriber
+ *  - returns false if not subscribed
+ */
+bool Subscriber::Unsubscribe(Publisher& pub)
+{
+    boost::mutex::scoped_lock connection_lock(connection_mutex_);
+
+    if (!pub.RemoveSubscriber(*this))
+    {
+        return false;
+    }
+
+    publishers_.erase(std::remove(publishers_.begin(), publishers_.end(), &pub), publishers_.end());
+    return true;
+}
+
+/*
+ * Returns a snapshot of the publishers currently subscribed to
+ */
+std::vector<Publisher*> Subscriber::publishers()
+{
+    boost::mutex::scoped_lock connection_lock(connection_mutex_);
+    return publishers_;
+}
+
 /*
  * Message mutator
  *  - is called by a connected publisher when there is a new message
+ *  - in conflate mode: overwrites the publisher's previous (stale) message, never waits
  *  - thread-safe
  */
-void Subscriber::set_message(std::string str)
+void Subscriber::set_message(Message msg)
+{
+    Store(&msg, &msg + 1);
+}
+
+/*
+ * Batch mutator
+ *  - is called by a connected publisher when there is a new batch of messages
+ *  - the batch is handed over with a single lock and wake-up, and displayed as a unit
+ *  - thread-safe
+ */
+void Subscriber::set_batch(const MessageBatch& batch)
+{
+    if (!batch.empty())
+    {
+        Store(&batch[0], &batch[0] + batch.size());
+    }
+}
+
+/*
+ * Stores messages [first, last) in the shared resource
+ *  - waits until the previous message(s) are displayed, unless in conflate mode
+ */
+void Subscriber::Store(const Message* first, const Message* last)
 {
     // assure only one thread (a publisher) can access this code at a time
     boost::mutex::scoped_lock mutator_lock(message_mutex_);
 
+    // keep only the latest message per publisher and let the subscriber catch up
+    if (conflate_)
+    {
+        for (const Message* msg = first; msg != last; ++msg)
+        {
+            latest_[msg->publisher_id] = *msg;
+        }
+        wait_for_signal_ = false;
+        message_set_.notify_one();
+        return;
+    }
+
     // let this thread (a publisher) wait while another (a subscriber) is using the message for display
-    while(pending_display_)
+    while(pending_display_ && running_)
     {
         display_set_.wait(mutator_lock);
     }
 
-    message_ = str;             // set the publisher message
-    pending_display_ = true;    // set flag to let publisher threads wait
-    wait_for_signal_ = false;   // set flag to let a susbscriber thread display
-    message_set_.notify_one();  // notify a subscriber thread that it's now ready to display
+    // drop messages once stopped
+    if (!running_)
+    {
+        return;
+    }
+
+    messages_.assign(first, last);  // set the publisher message(s)
+    pending_display_ = true;        // set flag to let publisher threads wait
+    wait_for_signal_ = false;       // set flag to let a susbscriber thread display
+    message_set_.notify_one();      // notify a subscriber thread that it's now ready to display
 }
 
 /*
  * Displays a new message received from a publisher
- *  - runs an infinate loop
+ *  - loops until stopped
+ *  - in conflate mode: displays the freshest message of each publisher
  *  - thread-safe
  */
 void Subscriber::DisplayMessage()
 {
-    while(true) // infinate loop
+    while(running_)
     {
         // assure only one thread (a subscriber) can access this code at a time
         boost::mutex::scoped_lock display_lock(message_mutex_);
 
         // let this thread (a subscriber) wait while another (a publisher) is setting the message
-        while(wait_for_signal_)
+        while(wait_for_signal_ && running_)
         {
             message_set_.wait(display_lock);
         }
 
-        // append this object's id and this thread's id to the message
-        message_.append(" to Sub ");
-        message_.append(boost::lexical_cast<std::string>(id_));
-        message_.append(" [thr_ID: ");
-        message_.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
-        message_.append("]");
+        if (!running_)
+        {
+            break;
+        }
 
-        std::cout << message_ << std::endl;  // display the message
+        if (conflate_)
+        {
+            // take the cached messages, so publishers can keep overwriting during display
+            std::map<int, Message> latest;
+            latest.swap(latest_);
+            wait_for_signal_ = true;
+            display_lock.unlock();
+
+            for (std::map<int, Message>::iterator it = latest.begin(); it != latest.end(); ++it)
+            {
+                Deliver(it->second);
+            }
+            continue;
+        }
+
+        // display the message(s)
+        for (unsigned i=0; i<messages_.size(); i++)
+        {
+            Deliver(messages_[i]);
+        }
 
-        message_.assign("");        // clear the message
+        messages_.clear();          // clear the message(s)
         pending_display_ = false;   // set flag to let a publisher thread set the next message
         wait_for_signal_ = true;    // set flag to let this subscriber thread wait for the next message
         display_set_.notify_one();  // notify a publisher thread that it's now ready to set the next message
     }
 }
+
+/*
+ * Registers a reader of a publisher's ring
+ *  - @filter: the messages wanted (default: all), checked by this subscriber as it reads
+ *  - call before ReadRings
+ */
+void Subscriber::AddRing(boost::shared_ptr<BroadcastRing> ring, int reader, const Filter& filter)
+{
+    RingReader ring_reader;
+    ring_reader.ring = ring;
+    ring_reader.reader = reader;
+    ring_reader.filter = filter;
+    ring_reader.is_filtered = !filter.keys.empty() || filter.HasRange() || !filter.topics.empty();
+    rings_.push_back(ring_reader);
+}
+
+/*
+ * Displays new messages read from the publishers' broadcast rings
+ *  - loops until stopped
+ *  - lock-free: each ring is read through this subscriber's own cursor
+ */
+void Subscriber::ReadRings()
+{
+    Message msg;
+
+    while(running_)
+    {
+        // take (at most) one message from each ring per round
+        bool is_idle = true;
+        for (unsigned i=0; i<rings_.size(); i++)
+        {
+            if (rings_[i].ring->TryRead(rings_[i].reader, msg))
+            {
+                // the ring carries every message: drop those the filter rejects
+                if (!rings_[i].is_filtered || rings_[i].filter.Matches(msg))
+                {
+                    Deliver(msg);
+                }
+                is_idle = false;
+            }
+        }
+
+        // nothing published yet
+        if (is_idle)
+        {
+            boost::this_thread::yield();
+        }
+    }
+}
+
+/*
+ * Stops message processing
+ *  - publishers waiting on this subscriber are released, later messages are dropped
+ */
+void Subscriber::Stop()
+{
+    boost::mutex::scoped_lock stop_lock(message_mutex_);
+
+    running_ = false;
+    message_set_.notify_all();
+    display_set_.notify_all();
+}
+
+/*
+ * Passes a message to the handler, or displays it if there is none
+ */
+void Subscriber::Deliver(const Message& msg)
+{
+    if (handler_)
+    {
+        handler_(msg);
+    }
+    else
+    {
+        Display(msg.text);
+    }
+}
+
+/*
+ * Appends this object's id and this thread's id to a message and displays it
+ */
+void Subscriber::Display(std::string str)
+{
+    str.append(" to Sub ");
+    str.append(boost::lexical_cast<std::string>(id_));
+    str.append(" [thr_ID: ");
+    str.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
+    str.append("]");
+
+    std::cout << str << std::endl;
+}
@@ -1,8 +1,15 @@
 #ifndef SUBSCRIBER_H
 #define SUBSCRIBER_H
-#include <boost/signals2.hpp>
+#include <map>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
+#include "broadcast_ring.h"
+#include "filter.h"
+#include "message.h"
+
+class Publisher;
 
 /*
  * Class representation for subscribers
@@ -11,22 +18,51 @@ class Subscriber
 {
     public:
         // Constructor: initialises condition variables
-        Subscriber(){wait_for_signal_ = true; pending_display_ = false;}
+        Subscriber(){wait_for_signal_ = true; pending_display_ = false; conflate_ = false; running_ = true;}
         void set_id(int id) {id_ = id;}
+        void set_conflate(bool conflate) {conflate_ = conflate;}  // opts in last-value delivery
+        void set_handler(boost::function<void (const Message&)> handler) {
+                                handler_ = handler;}           // handles messages instead of displaying them
+        void Stop();                                           // makes DisplayMessage/ReadRings return
 
-        void set_message(std::string str);                     // message mutator
+        void set_message(Message msg);                         // message mutator
+        void set_batch(const MessageBatch& batch);             // batch mutator (one hand-over per batch)
         void DisplayMessage();                                 // displays message received from publisher
-        void AddConnection(boost::signals2::connection con){
-                                connections_.push_back(con);}  // keeps record of subscriptions
+        void ReadRings();                                      // displays messages read from publishers' rings
+        bool Subscribe(Publisher& pub,
+                       const Filter& filter = Filter());       // subscribes to a publisher (at any time)
+        bool Unsubscribe(Publisher& pub);                      // unsubscribes from a publisher (at any time)
+        std::vector<Publisher*> publishers();                  // publishers currently subscribed to
+        void AddRing(boost::shared_ptr<BroadcastRing> ring, int reader,
+                     const Filter& filter = Filter());         // keeps record of a ring reader (and its filter)
 
     private:
-        std::vector<boost::signals2::connection> connections_;  // connections to publishers (unused for now)
+        void Store(const Message* first, const Message* last);  // hands messages over to the subscriber thread
+        void Deliver(const Message& msg);                       // passes a message to handler_ (or displays it)
+        void Display(std::string str);                          // appends sub info and prints a message
+
+        std::vector<Publisher*> publishers_;                    // publishers subscribed to
+        boost::mutex connection_mutex_;                         // publishers_ mutex (never taken by publishers)
+        // a publisher's ring, read through this subscriber's own reader
+        struct RingReader
+        {
+            boost::shared_ptr<BroadcastRing> ring;
+            int reader;            // reader index in the ring
+            Filter filter;         // checked on read (the ring is written once for all readers)
+            bool is_filtered;      // false: accepts everything (filter skipped)
+        };
+
+        std::vector<RingReader> rings_;                         // publishers' rings read
         boost::mutex message_mutex_;                            // resource mutex
         boost::condition_variable message_set_,             // condition variable for subscribers
                                   display_set_;             // condition variable for publishers
         bool wait_for_signal_,  // flag for subscriber to wait
-             pending_display_;  // flag for publisher to wait
-        std::string message_;   // shared resource
+             pending_display_,  // flag for publisher to wait
+             conflate_;         // flag for last-value delivery (publishers overwrite instead of waiting)
+        boost::atomic<bool> running_;   // flag for processing to go on
+        MessageBatch messages_;         // shared resource (a single message, or a batch)
+        boost::function<void (const Message&)> handler_;  // message handler (none: display)
+        std::map<int, Message> latest_;  // last-value cache keyed by publisher id (conflate mode only)
         int id_;
 };
 
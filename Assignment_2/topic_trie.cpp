@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <cstring>
+#include <boost/functional/hash.hpp>
+#include "topic_trie.h"
+
+const unsigned TopicTrie::kMaxMatchedLists;
+const unsigned TopicTrie::kMaxHashVisits;
+const unsigned TopicTrie::kMinCachedListSize;
+const unsigned TopicTrie::kUnionCacheSlots;
+const unsigned TopicCache::kDefaultSlots;
+const unsigned TopicCache::kWays;
+
+static boost::atomic<unsigned> trie_generations(0);  // unique across tries (copies share their cache)
+
+/*
+ * Returns the end of the level starting at @start
+ */
+static std::string::size_type LevelEnd(const std::string& str, std::string::size_type start)
+{
+    std::string::size_type dot = str.find('.', start);
+    return (dot == std::string::npos) ? str.size() : dot;
+}
+
+/*
+ * Returns the start of the level after the one starting at @start (npos: none left)
+ */
+static std::string::size_type NextLevel(const std::string& str, std::string::size_type start)
+{
+    std::string::size_type dot = str.find('.', start);
+    return (dot == std::string::npos) ? std::string::npos : dot + 1;
+}
+
+/*
+ * Writes the union of two sorted lists (without duplicates) to @out, returns its end
+ *  - @out may overlap @a, as long as it does not start after it
+ *  - a much shorter @b is inserted by binary search, the rest of @a copied in blocks
+ *  - otherwise branch-free steps: the lists of a match interleave unpredictably
+ */
+static unsigned* Union(const unsigned* a, const unsigned* a_end,
+                       const unsigned* b, const unsigned* b_end, unsigned* out)
+{
+    std::size_t a_size = a_end - a,
+                b_size = b_end - b;
+
+    if (b_size * 16 < a_size)
+    {
+        for (; b != b_end; b++)
+        {
+            const unsigned* next = std::lower_bound(a, a_end, *b);
+            out = std::copy(a, next, out);
+            a = (next != a_end && *next == *b) ? next + 1 : next;
+            *out++ = *b;
+        }
+        return std::copy(a, a_end, out);
+    }
+
+    // a subscriber in both lists (several patterns) is written once
+    std::size_t i = 0,
+                j = 0;
+    while (i < a_size && j < b_size)
+    {
+        unsigned x = a[i],
+                 y = b[j];
+        *out++ = (x < y) ? x : y;
+        i += (x <= y);
+        j += (y <= x);
+    }
+    out = std::copy(a + i, a_end, out);
+    return std::copy(b + j, b_end, out);
+}
+
+/*
+ * Returns the hash of an exact level edge
+ */
+static std::size_t EdgeKey(int node, const char* level, std::size_t size)
+{
+    std::size_t key = boost::hash_range(level, level + size);
+    boost::hash_combine(key, node);
+    return key;
+}
+
+/*
+ * Removes all patterns (keeps an empty root)
+ */
+void TopicTrie::Clear()
+{
+    nodes_.assign(1, Node());
+    edges_.assign(16, Edge());
+    edges_count_ = 0;
+    generation_ = trie_generations.fetch_add(1, boost::memory_order_relaxed);
+    unions_.reset(new TopicCache(kUnionCacheSlots));
+}
+
+/*
+ * Registers a pattern for a subscriber
+ *  - consecutive "#" levels match what a single one does: only one is kept
+ */
+void TopicTrie::Insert(const std::string& pattern, unsigned subscriber)
+{
+    int node = 0;
+    bool is_hash = false;  // the previous level was "#"
+    for (std::string::size_type p = pattern.empty() ? std::string::npos : 0; p != std::string::npos;
+         p = NextLevel(pattern, p))
+    {
+        std::string::size_type end = LevelEnd(pattern, p);
+        bool is_level_hash = (pattern.compare(p, end - p, "#") == 0);
+        if (!(is_level_hash && is_hash))
+        {
+            node = Child(node, pattern.data() + p, end - p);
+        }
+        is_hash = is_level_hash;
+    }
+
+    std::vector<unsigned>& subscribers = nodes_[node].subscribers;
+    std::vector<unsigned>::iterator it = std::lower_bound(subscribers.begin(), subscribers.end(), subscriber);
+    if (it == subscribers.end() || *it != subscriber)
+    {
+        subscribers.insert(it, subscriber);
+    }
+
+    // the unions cached so far may be stale
+    generation_ = trie_generations.fetch_add(1, boost::memory_order_relaxed);
+}
+
+/*
+ * Finds the subscribers whose patterns match a topic
+ *  - @subscribers: set to the matching subscribers, sorted and without duplicates
+ *  - collects the (sorted) subscriber lists of the nodes reached, then merges them
+ */
+void TopicTrie::Match(const std::string& topic, std::vector<unsigned>& subscribers) const
+{
+    MatchState state;
+    subscribers.clear();
+    Collect(0, topic, topic.empty() ? std::string::npos : 0, state, subscribers);
+    Merge(state, subscribers);
+}
+
+/*
+ * Finds the child of a node for a pattern level, adds it if missing
+ */
+int TopicTrie::Child(int node, const char* level, std::size_t size)
+{
+    bool is_star = (size == 1 && level[0] == '*'),
+         is_hash = (size == 1 && level[0] == '#');
+    std::size_t key = 0;
+
+    // existing child
+    int child = -1;
+    if (is_star)
+    {
+        child = nodes_[node].star;
+    }
+    else if (is_hash)
+    {
+        child = nodes_[node].hash;
+    }
+    else
+    {
+        key = EdgeKey(node, level, size);
+        child = FindChild(node, level, size, key);
+    }
+
+    if (child != -1)
+    {
+        return child;
+    }
+
+    // new child (nodes_ may reallocate: keep indices, never references)
+    child = nodes_.size();
+    nodes_.push_back(Node());
+    if (is_star)
+    {
+        nodes_[node].star = child;
+    }
+    else if (is_hash)
+    {
+        nodes_[node].hash = child;
+    }
+    else
+    {
+        nodes_[child].level.assign(level, size);
+
+        // keep the table at most half full
+        if (2 * (edges_count_ + 1) > edges_.size())
+        {
+            std::vector<Edge> edges(2 * edges_.size());
+            edges.swap(edges_);
+            for (unsigned i=0; i<edges.size(); i++)
+            {
+                if (edges[i].child != -1)
+                {
+                    AddEdge(edges[i]);
+                }
+            }
+        }
+
+        Edge edge;
+        edge.key = key;
+        edge.parent = node;
+        edge.child = child;
+        AddEdge(edge);
+        edges_count_++;
+        nodes_[node].exact_count++;
+    }
+    return child;
+}
+
+/*
+ * Finds the exact level child of a node (-1: none)
+ *  - @key: EdgeKey(node, level, size)
+ */
+int TopicTrie::FindChild(int node, const char* level, std::size_t size, std::size_t key) const
+{
+    std::size_t mask = edges_.size() - 1;
+    for (std::size_t i = key & mask; edges_[i].child != -1; i = (i + 1) & mask)
+    {
+        const Edge& edge = edges_[i];
+        if (edge.key == key && edge.parent == node)
+        {
+            const std::string& child_level = nodes_[edge.child].level;
+            if (child_level.size() == size && std::memcmp(child_level.data(), level, size) == 0)
+            {
+                return edge.child;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Stores an edge in the first free slot from its key on
+ */
+void TopicTrie::AddEdge(const Edge& edge)
+{
+    std::size_t mask = edges_.size() - 1,
+                i = edge.key & mask;
+    while (edges_[i].child != -1)
+    {
+        i = (i + 1) & mask;
+    }
+    edges_[i] = edge;
+}
+
+/*
+ * Collects the subscriber lists of the patterns under a node that match the topic from @level on
+ *  - @level: start of the topic level to match (npos: all levels consumed)
+ *  - the lists are merged into @subscribers kMaxMatchedLists at a time
+ */
+void TopicTrie::Collect(int node, const std::string& topic, std::string::size_type level,
+                        MatchState& state, std::vector<unsigned>& subscribers) const
+{
+    const Node& current = nodes_[node];
+
+    // "#": any number of levels (the zero levels case included)
+    if (current.hash != -1)
+    {
+        CollectHash(current.hash, topic, level, state, subscribers);
+    }
+
+    // all levels consumed: patterns ending here match
+    if (level == std::string::npos)
+    {
+        if (current.subscribers.empty())
+        {
+            return;
+        }
+        if (state.nodes_count == kMaxMatchedLists)
+        {
+            Merge(state, subscribers);
+        }
+        state.nodes[state.nodes_count++] = node;
+        return;
+    }
+
+    // exact level
+    std::string::size_type end = LevelEnd(topic, level);
+    if (current.exact_count > 0)
+    {
+        const char* data = topic.data() + level;
+        int child = FindChild(node, data, end - level, EdgeKey(node, data, end - level));
+        if (child != -1)
+        {
+            Collect(child, topic, NextLevel(topic, level), state, subscribers);
+        }
+    }
+
+    // "*": any single level
+    if (current.star != -1)
+    {
+        Collect(current.star, topic, NextLevel(topic, level), state, subscribers);
+    }
+}
+
+/*
+ * Collects under a "#" node for every topic level from @level on
+ *  - a node reached again (several "#" in a pattern) only expands the levels it has not
+ *    expanded yet, so every node is matched at most once per topic level
+ */
+void TopicTrie::CollectHash(int node, const std::string& topic, std::string::size_type level,
+                            MatchState& state, std::vector<unsigned>& subscribers) const
+{
+    // already expanded from a topic level on: only the levels before it are left
+    std::string::size_type done = std::string::npos;  // (npos, the end, sorts last)
+    bool is_visited = false;
+    unsigned visit = 0;
+    while (visit < state.visits_count && state.visited[visit] != node)
+    {
+        visit++;
+    }
+    if (visit < state.visits_count)
+    {
+        if (level >= state.visited_from[visit])
+        {
+            return;
+        }
+        done = state.visited_from[visit];
+        is_visited = true;
+        state.visited_from[visit] = level;
+    }
+    else if (state.visits_count < kMaxHashVisits)
+    {
+        state.visited[state.visits_count] = node;
+        state.visited_from[state.visits_count++] = level;
+    }
+
+    for (std::string::size_type next = level; ; next = NextLevel(topic, next))
+    {
+        if (is_visited && next >= done)
+        {
+            return;
+        }
+        Collect(node, topic, next, state, subscribers);
+        if (next == std::string::npos)
+        {
+            return;
+        }
+    }
+}
+
+/*
+ * Merges the collected subscriber lists into @subscribers (sorted, no duplicates)
+ *  - the union of the large lists comes from the cache (merged and cached on a miss)
+ */
+void TopicTrie::Merge(MatchState& state, std::vector<unsigned>& subscribers) const
+{
+    const std::vector<unsigned>* lists[kMaxMatchedLists];
+    const std::vector<unsigned>* large[kMaxMatchedLists];
+    unsigned lists_count = 0,
+             large_count = 0;
+    std::string key(reinterpret_cast<const char*>(&generation_), sizeof(generation_));
+
+    for (unsigned i=0; i<state.nodes_count; i++)
+    {
+        const std::vector<unsigned>& list = nodes_[state.nodes[i]].subscribers;
+        if (list.size() >= kMinCachedListSize)
+        {
+            large[large_count++] = &list;
+            key.append(reinterpret_cast<const char*>(&state.nodes[i]), sizeof(state.nodes[i]));
+        }
+        else
+        {
+            lists[lists_count++] = &list;
+        }
+    }
+    state.nodes_count = 0;
+
+    // kept alive until merged (evicted or not)
+    TopicCache::EntryPtr entry;
+    if (large_count == 1)
+    {
+        lists[lists_count++] = large[0];
+    }
+    else if (large_count > 1)
+    {
+        std::size_t hash = boost::hash<std::string>()(key);
+        entry = unions_->Find(key, hash);
+        if (!entry)
+        {
+            boost::shared_ptr<TopicCache::Entry> fresh(new TopicCache::Entry);
+            fresh->topic = key;
+            MergeLists(large, large_count, fresh->subscribers);
+            unions_->Insert(fresh, hash);
+            entry = fresh;
+        }
+        lists[lists_count++] = &entry->subscribers;
+    }
+
+    MergeLists(lists, lists_count, subscribers);
+}
+
+/*
+ * Merges sorted lists into @subscribers (sorted, no duplicates)
+ *  - sized once for all of them, the longest list first: the shorter ones are then
+ *    inserted by binary search
+ *  - each further list: the matches so far are moved behind the room for it, then merged
+ *    forward into place (a write never passes the next match read)
+ *  - @lists: reordered, none empty
+ */
+void TopicTrie::MergeLists(const std::vector<unsigned>** lists, unsigned count,
+                           std::vector<unsigned>& subscribers)
+{
+    std::size_t total = subscribers.size();
+    for (unsigned i=0; i<count; i++)
+    {
+        total += lists[i]->size();
+
+        // insertion sort, longest first (a handful of lists)
+        for (unsigned j=i; j>0 && lists[j]->size() > lists[j - 1]->size(); j--)
+        {
+            std::swap(lists[j], lists[j - 1]);
+        }
+    }
+    subscribers.reserve(total);
+
+    unsigned i = 0;
+    if (subscribers.empty() && count > 0)
+    {
+        // the first two straight into place
+        const std::vector<unsigned>& first = *lists[i++];
+        if (count == 1)
+        {
+            subscribers.assign(first.begin(), first.end());
+            return;
+        }
+        const std::vector<unsigned>& second = *lists[i++];
+        subscribers.resize(first.size() + second.size());
+        unsigned* end = Union(&first[0], &first[0] + first.size(), &second[0], &second[0] + second.size(), &subscribers[0]);
+        subscribers.resize(end - &subscribers[0]);
+    }
+
+    for (; i<count; i++)
+    {
+        const std::vector<unsigned>& list = *lists[i];
+        std::size_t size = subscribers.size();
+        subscribers.resize(size + list.size());
+        unsigned* out = &subscribers[0];
+        std::copy_backward(out, out + size, out + subscribers.size());
+        unsigned* end = Union(out + list.size(), out + subscribers.size(), &list[0], &list[0] + list.size(), out);
+        subscribers.resize(end - out);
+    }
+}
+
+/*
+ * Constructor: allocates empty slots
+ *  - @slots: rounded up to whole sets
+ */
+TopicCache::TopicCache(unsigned slots) : sets_count_((slots + kWays - 1) / kWays),
+                                         slots_(new EntryPtr[sets_count_ * kWays]),
+                                         hashes_(new boost::atomic<std::size_t>[sets_count_ * kWays]),
+                                         referenced_(new boost::atomic<bool>[sets_count_ * kWays]),
+                                         hands_(new boost::atomic<unsigned>[sets_count_])
+{
+    for (unsigned i=0; i<sets_count_ * kWays; i++)
+    {
+        hashes_[i].store(0, boost::memory_order_relaxed);
+        referenced_[i].store(false, boost::memory_order_relaxed);
+    }
+    for (unsigned i=0; i<sets_count_; i++)
+    {
+        hands_[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+/*
+ * Looks up a topic
+ *  - @hash: the topic's hash
+ *  - returns NULL if the topic is not cached
+ *  - a hit marks the slot as referenced (spared by the next pass of the clock hand)
+ */
+TopicCache::EntryPtr TopicCache::Find(const std::string& topic, std::size_t hash) const
+{
+    unsigned first = (hash % sets_count_) * kWays;
+    for (unsigned i=first; i<first + kWays; i++)
+    {
+        // only load the entries of the same hash (an entry is always checked, the hash may be stale)
+        if (hashes_[i].load(boost::memory_order_relaxed) != hash)
+        {
+            continue;
+        }
+
+        EntryPtr entry = boost::atomic_load(&slots_[i]);
+        if (entry && (entry->topic == topic))
+        {
+            if (!referenced_[i].load(boost::memory_order_relaxed))
+            {
+                referenced_[i].store(true, boost::memory_order_relaxed);
+            }
+            return entry;
+        }
+    }
+    return EntryPtr();
+}
+
+/*
+ * Caches an entry in its set
+ *  - @hash: the entry topic's hash
+ *  - takes the first slot the clock hand finds unreferenced (free slots never are)
+ *    (after a full turn, every slot has been unreferenced: at most 2 * kWays steps)
+ *  - a topic raced in by several threads may end up cached twice (either copy is found)
+ */
+void TopicCache::Insert(const EntryPtr& entry, std::size_t hash)
+{
+    unsigned set = hash % sets_count_,
+             slot = 0;
+    for (unsigned step=0; step<2 * kWays; step++)
+    {
+        slot = set * kWays + hands_[set].fetch_add(1, boost::memory_order_relaxed) % kWays;
+        if (!referenced_[slot].exchange(false, boost::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    boost::atomic_store(&slots_[slot], entry);
+    hashes_[slot].store(hash, boost::memory_order_relaxed);
+}
+
+/*
+ * Matches a topic against a single pattern (same rules as TopicTrie, no trie built)
+ *  - compares level by level in place (npos: no level left)
+ *  - "#" is matched greedily, like a glob's '*': only the last "#" seen is
+ *    backtracked over, so matching stays linear in pattern x topic levels
+ *    however many "#" the pattern holds
+ */
+bool TopicMatches(const std::string& pattern, const std::string& topic)
+{
+    std::string::size_type p = pattern.empty() ? std::string::npos : 0,
+                           t = topic.empty() ? std::string::npos : 0,
+                           hash_p = std::string::npos,   // pattern level after the last "#" seen
+                           hash_t = std::string::npos;   // first topic level not taken by that "#"
+    bool is_hashed = false;                              // a "#" was seen
+
+    while (t != std::string::npos)
+    {
+        if (p != std::string::npos)
+        {
+            std::string::size_type p_end = LevelEnd(pattern, p);
+
+            // "#": takes no level for now
+            if (pattern.compare(p, p_end - p, "#") == 0)
+            {
+                is_hashed = true;
+                hash_p = NextLevel(pattern, p);
+                hash_t = t;
+                p = hash_p;
+                continue;
+            }
+
+            // "*": any single level, otherwise the same level
+            std::string::size_type t_end = LevelEnd(topic, t);
+            if ((pattern.compare(p, p_end - p, "*") == 0) ||
+                (pattern.compare(p, p_end - p, topic, t, t_end - t) == 0))
+            {
+                p = NextLevel(pattern, p);
+                t = NextLevel(topic, t);
+                continue;
+            }
+        }
+
+        // mismatch: let the last "#" take one more level
+        if (!is_hashed)
+        {
+            return false;
+        }
+        hash_t = NextLevel(topic, hash_t);
+        t = hash_t;
+        p = hash_p;
+    }
+
+    // topic consumed: only "#" may be left
+    while (p != std::string::npos && pattern.compare(p, LevelEnd(pattern, p) - p, "#") == 0)
+    {
+        p = NextLevel(pattern, p);
+    }
+    return p == std::string::npos;
+}
@@ -0,0 +1,125 @@
+#ifndef TOPIC_TRIE_H
+#define TOPIC_TRIE_H
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+
+class TopicCache;
+
+/*
+ * Trie of hierarchical topic patterns (levels separated by '.')
+ *  - "*" matches exactly one level, e.g. "eq.us.*" matches "eq.us.AAPL"
+ *  - "#" matches zero or more levels, e.g. "eq.#" matches "eq", "eq.us" and "eq.us.AAPL"
+ *  - a pattern is registered for a subscriber (index), a topic is matched against all patterns at once
+ *  - exact levels are looked up in one hash table of (parent node, level) edges, so matching
+ *    walks the topic in place: no level is copied
+ *  - each node keeps its subscribers sorted: a match merges the lists of the nodes reached
+ *  - the large lists reached together (wildcard patterns shared by many topics) are merged once,
+ *    then cached: a match only merges the few exact subscribers into that
+ *  - immutable once built (but for that cache): concurrent matching needs no lock
+ */
+class TopicTrie
+{
+    public:
+        TopicTrie() {Clear();}
+
+        void Clear();                                                   // removes all patterns
+        void Insert(const std::string& pattern, unsigned subscriber);   // registers a pattern
+        void Match(const std::string& topic,
+                   std::vector<unsigned>& subscribers) const;           // subscribers matching a topic (sorted)
+
+    private:
+        struct Node
+        {
+            Node() : star(-1), hash(-1), exact_count(0) {}
+
+            std::string level;                  // exact level from the parent (edge check)
+            int star,                           // "*" child node (-1: none)
+                hash,                           // "#" child node (-1: none)
+                exact_count;                    // exact level children (0: no edge lookup)
+            std::vector<unsigned> subscribers;  // patterns ending at this node (sorted, no duplicates)
+        };
+
+        struct Edge
+        {
+            Edge() : key(0), parent(-1), child(-1) {}
+
+            std::size_t key;  // hash of (parent, level)
+            int parent,
+                child;        // -1: free slot
+        };
+
+        static const unsigned kMaxMatchedLists = 16,    // subscriber lists collected before a merge
+                              kMaxHashVisits = 64,      // "#" nodes kept from re-expanding (more: unguarded)
+                              kMinCachedListSize = 32,  // lists whose unions are cached
+                              kUnionCacheSlots = 256;
+
+        // a match's working space (on the caller's stack)
+        struct MatchState
+        {
+            MatchState() : nodes_count(0), visits_count(0) {}
+
+            int nodes[kMaxMatchedLists];                          // nodes reached, with subscribers
+            unsigned nodes_count;
+            int visited[kMaxHashVisits];                          // "#" nodes expanded so far...
+            std::string::size_type visited_from[kMaxHashVisits];  // ... from these topic levels on
+            unsigned visits_count;
+        };
+
+        int Child(int node, const char* level, std::size_t size);  // finds or adds a child node
+        int FindChild(int node, const char* level, std::size_t size, std::size_t key) const;
+        void AddEdge(const Edge& edge);
+        void Collect(int node, const std::string& topic, std::string::size_type level,
+                     MatchState& state, std::vector<unsigned>& subscribers) const;
+        void CollectHash(int node, const std::string& topic, std::string::size_type level,
+                         MatchState& state, std::vector<unsigned>& subscribers) const;
+        void Merge(MatchState& state, std::vector<unsigned>& subscribers) const;
+        static void MergeLists(const std::vector<unsigned>** lists, unsigned count,
+                               std::vector<unsigned>& subscribers);
+
+        std::vector<Node> nodes_;                // nodes_[0] is the root
+        std::vector<Edge> edges_;                // exact level edges, open addressing (size: a power of 2)
+        std::size_t edges_count_;
+        unsigned generation_;                    // changed by every insert (cached unions key)
+        boost::shared_ptr<TopicCache> unions_;   // unions of large lists, by generation and nodes
+};
+
+/*
+ * Cache of topic match results (sets of kWays slots, CLOCK eviction within a set)
+ *  - a full set evicts the first entry not hit since the clock hand last passed it
+ *  - lookups and inserts take no lock but the brief per-slot spinlock of boost's shared_ptr atomics
+ *  - an entry stays valid for as long as a caller holds it, evicted or not
+ */
+class TopicCache : private boost::noncopyable
+{
+    public:
+        struct Entry
+        {
+            std::string topic;
+            std::vector<unsigned> subscribers;
+        };
+        typedef boost::shared_ptr<const Entry> EntryPtr;
+
+        static const unsigned kDefaultSlots = 16384,
+                              kWays = 4;
+
+        explicit TopicCache(unsigned slots = kDefaultSlots);
+
+        EntryPtr Find(const std::string& topic, std::size_t hash) const;  // cached entry, or NULL
+        void Insert(const EntryPtr& entry, std::size_t hash);            // caches an entry (may evict one)
+
+    private:
+        unsigned sets_count_;
+        boost::scoped_array<EntryPtr> slots_;                        // set i: slots [i * kWays, (i + 1) * kWays)
+        boost::scoped_array< boost::atomic<std::size_t> > hashes_;   // slot topics' hashes (skip other topics)
+        boost::scoped_array< boost::atomic<bool> > referenced_;      // slots hit since the clock hand last passed
+                                                                     // (eviction loads no entry)
+        boost::scoped_array< boost::atomic<unsigned> > hands_;       // clock hand of each set
+};
+
+bool TopicMatches(const std::string& pattern, const std::string& topic);  // matches a single pattern
+
+#endif // TOPIC_TRIE_H
@@ -14,16 +14,29 @@ CONFIG   -= app_bundle
 
 TEMPLATE = app
 
-INCLUDEPATH += /home/jim/boost_1_52_0
-LIBS += -L/home/jim/boost_1_52_0/stage/lib -lboost_system -lboost_thread -lboost_chrono
+# Boost 1.53 or later (Boost.Atomic, Boost.Lockfree)
+INCLUDEPATH += /home/jim/boost_1_53_0
+LIBS += -L/home/jim/boost_1_53_0/stage/lib -lboost_system -lboost_thread -lboost_chrono -lrt
 
 SOURCES += main.cpp \
     publisher.cpp \
     subscriber.cpp \
-    communication.cpp
+    communication.cpp \
+    framing.cpp \
+    message.cpp \
+    shared_ring.cpp \
+    journal.cpp \
+    metrics.cpp \
+    broker.cpp
 
 HEADERS += \
     publisher.h \
     subscriber.h \
     communication.h \
-    options.h
+    options.h \
+    framing.h \
+    message.h \
+    shared_ring.h \
+    journal.h \
+    metrics.h \
+    broker.h
@@ -0,0 +1,453 @@
+/* ---------------------------------------------------------------------------------
+ * Publishers-Subscribers LOOPBACK BENCHMARK
+ *   - runs N publishers and M subscribers in one process, over loopback TCP
+ *   - sweeps payload size, publish rate, io thread count and fan-out (subscribers)
+ *   - runs every configuration for a fixed duration, then shuts it down cleanly
+ *   - writes one CSV row of throughput and latency percentiles per configuration
+ *
+ * ---------------------------------------------------------------------------------
+ * USAGE: takes 1 arguement (the benchmark configuration file)
+ *
+ *             e.g.  1st arguement: benchmark.config
+ *
+ * ---------------------------------------------------------------------------------
+ * NOTES: (1) every list is comma-separated, all their combinations are run;
+ *            rates are per publisher, in messages per second (or "unlimited")
+ *
+ *                  e.g. <benchmark duration_s = "5" publishers = "1" base_port = "9400"
+ *                                  queue_capacity = "65536" output = "benchmark.csv">
+ *                           <sweep payload_bytes = "64,1024" rates = "10000,unlimited"
+ *                                  io_threads = "1,2" fanouts = "1,4"/>
+ *                       </benchmark>
+ *
+ *        (2) each configuration listens on its own ports (from base_port on), so
+ *            sockets of the previous one still closing do not get in the way
+ *
+ *        (3) latencies are publish to receive and receive to process (see NOTE (12)
+ *            of the pub/sub programme), merged over all subscribers and publishers,
+ *            in microseconds; all the messages published are waited for (up to
+ *            kMaxDrainMs), so the tail of an overloaded run shows in them; the
+ *            rates are over the publishing duration
+ *
+ *        (4) the subscribers may instead connect through a broker, and subscribe
+ *            to some of the topics the publishers publish in turn; nothing is lost
+ *            on loopback, so messages counted missing (CSV column "missing") while
+ *            none was dropped are false gaps, and reported as an error
+ *
+ *                  e.g. <benchmark ... broker = "true" topics = "prices,news.eu,news.us"
+ *                                  subscribe = "news.*">
+ *
+ * ---------------------------------------------------------------------------------
+ */
+
+#include <boost/thread.hpp>
+#include <boost/asio.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/chrono.hpp>
+#include <fstream>
+#include "../publisher.h"
+#include "../subscriber.h"
+#include "../broker.h"
+#include "../options.h"
+
+const int kConnectTimeoutMs = 5000;  // wait for every subscriber to connect, per configuration
+const int kDrainPollMs = 100;        // the messages in flight are delivered once a poll sees none arrive
+const int kMaxDrainMs = 5000;        // time left at most to deliver them
+
+// Struct for one benchmark configuration
+struct BenchmarkCase
+{
+    std::size_t payload_bytes;
+    std::string rate;                // messages per second per publisher, or "unlimited"
+    int io_threads;
+    int fanout;                      // subscribers, each one subscribed to every publisher
+};
+
+// Struct for the benchmark options (used for the xml parser)
+struct BenchmarkOptions
+{
+    int duration_s;
+    int publishers;
+    int base_port;
+    std::size_t queue_capacity;
+    std::string output;
+    bool is_brokered;                    // subscribers connect through a broker
+    std::vector<std::string> topics,     // published in turn, empty: the pub id
+                             subscribe;  // subscribed to by every subscriber, empty: all
+    std::vector<BenchmarkCase> cases;
+};
+
+std::vector<std::string> SplitList(std::string list);
+void SetOptions(BenchmarkOptions& options, boost::property_tree::ptree opt);
+void RunCase(const BenchmarkOptions& options, const BenchmarkCase& bench, int port, std::ofstream& csv);
+unsigned long ProcessedCount(const std::vector< boost::shared_ptr<Subscriber> >& subs);
+
+/*
+ * Main function
+ */
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cout << "ERROR -> USAGE: takes 1 arguement (the benchmark configuration file) \n\n" <<
+                     "      e.g.  1st arguement: benchmark.config \n\n";
+        return -1;
+    }
+
+    // read the xml (config) file into a boost property tree
+    std::ifstream config(argv[1]);
+    boost::property_tree::ptree opt;
+    read_xml(config, opt);
+
+    BenchmarkOptions options;
+    SetOptions(options, opt);
+
+    std::ofstream csv(options.output.c_str());
+    if (!csv)
+    {
+        std::cout << "ERROR -> cannot write " << options.output << "\n\n";
+        return -1;
+    }
+    csv << "payload_bytes,rate,io_threads,publishers,subscribers,duration_s,"
+        << "published,delivered,dropped,missing,published_per_s,delivered_per_s,delivered_mb_per_s,"
+        << "p2r_p50_us,p2r_p90_us,p2r_p99_us,p2r_p999_us,p2r_max_us,"
+        << "r2p_p50_us,r2p_p99_us,r2p_max_us" << std::endl;
+
+    // every configuration on ports of its own (the broker's after the pubs')
+    for (unsigned i=0; i<options.cases.size(); i++)
+    {
+        std::cout << "[benchmark] " << i + 1 << "/" << options.cases.size()
+                  << ": payload_bytes = " << options.cases[i].payload_bytes
+                  << ", rate = " << options.cases[i].rate
+                  << ", io_threads = " << options.cases[i].io_threads
+                  << ", fanout = " << options.cases[i].fanout << std::endl;
+
+        RunCase(options, options.cases[i], options.base_port + static_cast<int>(i) * (options.publishers + 1), csv);
+    }
+
+    std::cout << "[benchmark] Results in " << options.output << std::endl;
+    return 0;
+}
+
+/*
+ * Splits a comma-separated list, dropping empty entries
+ */
+std::vector<std::string> SplitList(std::string list)
+{
+    std::vector<std::string> split;
+    boost::split(split, list, boost::is_any_of(","));
+
+    std::vector<std::string> result;
+    for (unsigned i=0; i<split.size(); i++)
+    {
+        boost::trim(split[i]);
+        if (!split[i].empty())
+        {
+            result.push_back(split[i]);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Sets the benchmark options, one case per combination of the swept values
+ */
+void SetOptions(BenchmarkOptions& options, boost::property_tree::ptree opt)
+{
+    options.duration_s = opt.get<int>("benchmark.<xmlattr>.duration_s", 5);
+    options.publishers = opt.get<int>("benchmark.<xmlattr>.publishers", 1);
+    options.base_port = opt.get<int>("benchmark.<xmlattr>.base_port", 9400);
+    options.queue_capacity = opt.get<std::size_t>("benchmark.<xmlattr>.queue_capacity", 65536);
+    options.output = opt.get<std::string>("benchmark.<xmlattr>.output", "benchmark.csv");
+    options.is_brokered = (opt.get<std::string>("benchmark.<xmlattr>.broker", "false") == "true");
+    options.topics = SplitList(opt.get<std::string>("benchmark.<xmlattr>.topics", ""));
+    options.subscribe = SplitList(opt.get<std::string>("benchmark.<xmlattr>.subscribe", ""));
+
+    std::vector<std::string> payload_bytes = SplitList(opt.get<std::string>("benchmark.sweep.<xmlattr>.payload_bytes", "64")),
+                             rates = SplitList(opt.get<std::string>("benchmark.sweep.<xmlattr>.rates", "unlimited")),
+                             io_threads = SplitList(opt.get<std::string>("benchmark.sweep.<xmlattr>.io_threads", "1")),
+                             fanouts = SplitList(opt.get<std::string>("benchmark.sweep.<xmlattr>.fanouts", "1"));
+
+    if (options.duration_s < 1 || options.publishers < 1)
+    {
+        std::cout << "ERROR -> in the configuration file: \n" <<
+                     "duration_s and publishers should be at least 1 \n\n" <<
+                     "      e.g. <benchmark duration_s = \"5\" publishers = \"1\"/>\n\n";
+        exit(-1);
+    }
+
+    for (unsigned a=0; a<payload_bytes.size(); a++)
+    {
+        for (unsigned b=0; b<rates.size(); b++)
+        {
+            for (unsigned c=0; c<io_threads.size(); c++)
+            {
+                for (unsigned d=0; d<fanouts.size(); d++)
+                {
+                    BenchmarkCase bench;
+                    bench.payload_bytes = boost::lexical_cast<std::size_t>(payload_bytes[a]);
+                    bench.rate = rates[b];
+                    bench.io_threads = std::max(boost::lexical_cast<int>(io_threads[c]), 1);
+                    bench.fanout = std::max(boost::lexical_cast<int>(fanouts[d]), 1);
+                    options.cases.push_back(bench);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Runs one configuration and writes its CSV row
+ *  - @port: the first publisher's listening port, the others (then the broker's) follow
+ *  - the producers start once every subscriber is connected, and stop before the
+ *    subscribers exit; these exit once the messages in flight are delivered
+ */
+void RunCase(const BenchmarkOptions& options, const BenchmarkCase& bench, int port, std::ofstream& csv)
+{
+    std::vector< boost::shared_ptr<Publisher> > pubs;
+    std::vector< boost::shared_ptr<Subscriber> > subs;
+    boost::shared_ptr<Broker> broker;
+    std::vector<Connection> connections;
+
+    // launch the pubs, not publishing yet
+    for (int i=0; i<options.publishers; i++)
+    {
+        PubOptions opt;
+        opt.pub_id = "bench_pub_" + boost::lexical_cast<std::string>(i + 1);
+        opt.threads = bench.io_threads;
+        opt.io_service_pool_size = 0;
+        opt.port = boost::lexical_cast<std::string>(port + i);
+        opt.rand_intervals = false;
+        opt.upper_bound_ms = 1;
+        opt.unlimited_rate = (bench.rate == "unlimited");
+        opt.rate = opt.unlimited_rate ? 0 : boost::lexical_cast<double>(bench.rate);
+        opt.payload_size = bench.payload_bytes;
+        opt.max_message_size = std::max(kDefaultMaxMessageSize, bench.payload_bytes + 1024);
+        opt.replay_buffer_size = kDefaultReplayBufferSize;
+        opt.high_watermark_bytes = kDefaultHighWatermarkBytes;
+        opt.low_watermark_bytes = kDefaultLowWatermarkBytes;
+        opt.slow_consumer_policy = kDisconnectSlowConsumer;
+        opt.journal_segment_size = kDefaultJournalSegmentSize;
+        opt.journal_sync_every = 0;
+        opt.journal_sync_interval_ms = 0;
+        opt.shared_ring_slots = kDefaultSharedRingSlots;
+        opt.shared_ring_slot_size = kDefaultSharedRingSlotSize;
+        opt.tcp_fanout = true;
+        opt.metrics_interval_ms = 1000;
+
+        boost::shared_ptr<Publisher> pub(new Publisher);
+        pub->set_id(opt.pub_id);
+        pub->set_rand_intervals(opt.rand_intervals);
+        pub->set_upper_bound_ms(opt.upper_bound_ms);
+        pub->set_rate(opt.rate);
+        pub->set_unlimited_rate(opt.unlimited_rate);
+        pub->set_payload_size(opt.payload_size);
+        pub->set_topics(options.topics);
+        pub->Launch(opt);
+        pubs.push_back(pub);
+
+        Connection con;
+        con.pub_id = opt.pub_id;
+        con.ip = "127.0.0.1";
+        con.port = opt.port;
+        connections.push_back(con);
+    }
+
+    // launch the broker, connected to every pub, then connect the subs to it instead
+    if (options.is_brokered)
+    {
+        BrokerOptions opt;
+        opt.broker_id = "bench_broker";
+        opt.threads = bench.io_threads;
+        opt.upstream_threads = bench.io_threads + 1;
+        opt.io_service_pool_size = 0;
+        opt.port = boost::lexical_cast<std::string>(port + options.publishers);
+        opt.max_message_size = std::max(kDefaultMaxMessageSize, bench.payload_bytes + 1024);
+        opt.queue_capacity = options.queue_capacity;
+        opt.high_watermark_bytes = kDefaultHighWatermarkBytes;
+        opt.low_watermark_bytes = kDefaultLowWatermarkBytes;
+        opt.slow_consumer_policy = kDisconnectSlowConsumer;
+        opt.catch_up_sequence = 0;
+        opt.catch_up_seconds = 0;
+        opt.reconnect_initial_ms = kDefaultReconnectInitialMs;
+        opt.reconnect_max_ms = kDefaultReconnectMaxMs;
+        opt.reconnect_max_attempts = 0;
+        opt.metrics_interval_ms = 1000;
+        opt.connections_count = options.publishers;
+        opt.pubs = connections;
+
+        broker.reset(new Broker);
+        broker->set_id(opt.broker_id);
+        broker->Launch(opt);
+        broker->upstream()->io_service()->post(boost::bind(&Broker::GetMessages,
+                                                           broker.get()));
+
+        Connection con;
+        con.pub_id = opt.broker_id;
+        con.ip = "127.0.0.1";
+        con.port = opt.port;
+        connections.assign(1, con);
+    }
+    for (unsigned i=0; i<connections.size(); i++)
+    {
+        connections[i].topics = options.subscribe;
+    }
+
+    // launch the subs, one connection to every pub (or the broker) each, displaying nothing
+    for (int i=0; i<bench.fanout; i++)
+    {
+        SubOptions opt;
+        opt.sub_id = "bench_sub_" + boost::lexical_cast<std::string>(i + 1);
+        opt.threads = bench.io_threads + 1;
+        opt.io_service_pool_size = 0;
+        opt.connections_count = connections.size();
+        opt.max_message_size = std::max(kDefaultMaxMessageSize, bench.payload_bytes + 1024);
+        opt.processing_threads = 1;
+        opt.queue_capacity = options.queue_capacity;
+        opt.catch_up_sequence = 0;
+        opt.catch_up_seconds = 0;
+        opt.reconnect_initial_ms = kDefaultReconnectInitialMs;
+        opt.reconnect_max_ms = kDefaultReconnectMaxMs;
+        opt.reconnect_max_attempts = 0;
+        opt.display_every = 0;
+        opt.metrics_interval_ms = 1000;
+        opt.pubs = connections;
+
+        boost::shared_ptr<Subscriber> sub(new Subscriber);
+        sub->set_id(opt.sub_id);
+        sub->Launch(opt);
+        sub->com()->io_service()->post(boost::bind(&Subscriber::GetMessages,
+                                                   sub.get()));
+        subs.push_back(sub);
+    }
+
+    // wait for every subscriber (or the broker, then every subscriber to it) to connect
+    std::vector< boost::shared_ptr<Communication> > servers;
+    for (unsigned i=0; i<pubs.size(); i++)
+    {
+        servers.push_back(pubs[i]->com());
+    }
+    if (broker)
+    {
+        servers.push_back(broker->downstream());
+    }
+
+    boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() +
+                                                       boost::chrono::milliseconds(kConnectTimeoutMs);
+    for (unsigned i=0; i<servers.size(); i++)
+    {
+        std::size_t clients = (broker && i < pubs.size()) ? 1 : static_cast<std::size_t>(bench.fanout);
+        while (servers[i]->client_count() < clients && boost::chrono::steady_clock::now() < deadline)
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        }
+        if (servers[i]->client_count() < clients)
+        {
+            std::cout << "[benchmark] Warning: only " << servers[i]->client_count() << " of "
+                      << clients << " subscribers connected" << std::endl;
+        }
+    }
+
+    // publish for the duration
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    for (unsigned i=0; i<pubs.size(); i++)
+    {
+        pubs[i]->StartPublishing();
+    }
+    boost::this_thread::sleep_for(boost::chrono::seconds(options.duration_s));
+    for (unsigned i=0; i<pubs.size(); i++)
+    {
+        pubs[i]->StopPublishing();
+    }
+    double elapsed_s = boost::chrono::duration_cast<boost::chrono::duration<double> >(
+                           boost::chrono::steady_clock::now() - start).count();
+
+    // let the messages in flight arrive, then exit the subs before the pubs
+    unsigned long processed = ProcessedCount(subs),
+                  last_processed;
+    deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(kMaxDrainMs);
+    do
+    {
+        last_processed = processed;
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(kDrainPollMs));
+        processed = ProcessedCount(subs);
+    }
+    while (processed != last_processed && boost::chrono::steady_clock::now() < deadline);
+
+    HdrHistogram publish_to_receive,
+                 receive_to_process;
+    unsigned long published = 0,
+                  dropped = 0,
+                  missing = 0;
+
+    for (unsigned i=0; i<subs.size(); i++)
+    {
+        subs[i]->Exit();
+        dropped += subs[i]->com()->dropped_messages();
+        missing += subs[i]->com()->missing_messages();
+
+        std::map<std::string, boost::shared_ptr<PublisherLatency> > latencies = subs[i]->com()->latencies();
+        for (std::map<std::string, boost::shared_ptr<PublisherLatency> >::const_iterator it = latencies.begin();
+             it != latencies.end(); ++it)
+        {
+            publish_to_receive.Add(it->second->publish_to_receive);
+            receive_to_process.Add(it->second->receive_to_process);
+        }
+    }
+    if (broker)
+    {
+        broker->Exit();
+        dropped += broker->upstream()->dropped_messages();
+        missing += broker->upstream()->missing_messages();
+    }
+    for (unsigned i=0; i<pubs.size(); i++)
+    {
+        published += pubs[i]->com()->written_messages();
+        pubs[i]->Exit();
+    }
+
+    // nothing is lost on loopback: gaps without drops (a broker's make real gaps) are false
+    if (missing > 0 && dropped == 0)
+    {
+        std::cout << "[benchmark] Error: " << missing << " message(s) counted missing" << std::endl;
+    }
+
+    // one row, latencies in microseconds
+    unsigned long delivered = receive_to_process.count();
+    csv << bench.payload_bytes << "," << bench.rate << "," << bench.io_threads << ","
+        << options.publishers << "," << bench.fanout << "," << elapsed_s << ","
+        << published << "," << delivered << "," << dropped << "," << missing << ","
+        << published / elapsed_s << "," << delivered / elapsed_s << ","
+        << delivered * bench.payload_bytes / elapsed_s / 1e6 << ","
+        << publish_to_receive.Percentile(50) / 1e3 << ","
+        << publish_to_receive.Percentile(90) / 1e3 << ","
+        << publish_to_receive.Percentile(99) / 1e3 << ","
+        << publish_to_receive.Percentile(99.9) / 1e3 << ","
+        << publish_to_receive.max_ns() / 1e3 << ","
+        << receive_to_process.Percentile(50) / 1e3 << ","
+        << receive_to_process.Percentile(99) / 1e3 << ","
+        << receive_to_process.max_ns() / 1e3 << std::endl;
+}
+
+/*
+ * Returns the messages processed by all subscribers so far
+ */
+unsigned long ProcessedCount(const std::vector< boost::shared_ptr<Subscriber> >& subs)
+{
+    unsigned long count = 0;
+    for (unsigned i=0; i<subs.size(); i++)
+    {
+        std::map<std::string, boost::shared_ptr<PublisherLatency> > latencies = subs[i]->com()->latencies();
+        for (std::map<std::string, boost::shared_ptr<PublisherLatency> >::const_iterator it = latencies.begin();
+             it != latencies.end(); ++it)
+        {
+            count += it->second->receive_to_process.count();
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,131 @@
+#include "broker.h"
+
+/*
+ * Launches the broker
+ *  - @opt: the options parsed from the config file
+ *  - downstream subscribers may connect before upstream is; they are then sent
+ *    the messages relayed from then on
+ *  - downstream keeps no replay ring: it relays several publishers, whose sequence
+ *    numbers do not make one resumable stream, so subscribers resume live only
+ */
+void Broker::Launch(BrokerOptions opt)
+{
+    downstream_->InitIoService();
+    downstream_->set_max_message_size(opt.max_message_size);
+    downstream_->InitIoServicePool(opt.io_service_pool_size);
+    downstream_->set_replay_capacity(0);
+    downstream_->set_slow_consumer(opt.high_watermark_bytes, opt.low_watermark_bytes, opt.slow_consumer_policy);
+    downstream_->LaunchThreads(opt.threads);
+    downstream_->Accept(opt.port);
+
+    upstream_->InitIoService();
+    upstream_->set_max_message_size(opt.max_message_size);
+    upstream_->InitIoServicePool(opt.io_service_pool_size);
+    upstream_->InitMessageQueue(opt.queue_capacity);
+    upstream_->set_catch_up(opt.catch_up_sequence, opt.catch_up_seconds);
+    upstream_->set_reconnect(opt.reconnect_initial_ms, opt.reconnect_max_ms, opt.reconnect_max_attempts);
+    upstream_->LaunchThreads(opt.upstream_threads);
+
+    // one exporter for both sides
+    upstream_->set_id(opt.broker_id);
+    if (!opt.metrics_port.empty() || !opt.metrics_file.empty())
+    {
+        downstream_->EnableMetrics(opt.broker_id, opt.metrics_port, opt.metrics_file, opt.metrics_interval_ms,
+                                   boost::bind(&Broker::CollectMetrics,
+                                               this,
+                                               _1));
+    }
+
+    // upstream topic filters, sent on connecting
+    for (unsigned i=0; i<opt.pubs.size(); i++)
+    {
+        for (unsigned j=0; j<opt.pubs[i].topics.size(); j++)
+        {
+            upstream_->Subscribe(opt.pubs[i].pub_id, opt.pubs[i].topics[j]);
+        }
+    }
+
+    upstream_->Connect(opt.connections_count, opt.pubs);
+
+    relay_thread_ = boost::thread(boost::bind(&Broker::RelayMessages,
+                                              this));
+}
+
+/*
+ * Provides a clean exit
+ *  - stops upstream first, so that nothing is relayed to a stopped downstream
+ *  - reports the relay queue metrics and latency percentiles
+ */
+void Broker::Exit()
+{
+    upstream_->PrepareForExit("client");
+    relay_thread_.join();
+    downstream_->PrepareForExit("server");
+
+    std::cout << "[" << boost::this_thread::get_id()
+              << "] Relay queue: max depth = " << upstream_->max_queue_depth()
+              << ", dropped = " << upstream_->dropped_messages()
+              << ", missing = " << upstream_->missing_messages()
+              << ", duplicates = " << upstream_->duplicate_messages()
+              << ", recovered = " << upstream_->recovered_messages()
+              << ", relayed = " << downstream_->written_messages() << std::endl;
+
+    upstream_->ReportLatency();
+}
+
+/*
+ * Gets message(s) from upstream publisher(s)
+ *  - loops till all upstream pubs are disconnected or the broker exits (manually)
+ */
+void Broker::GetMessages()
+{
+    // wait for the first remote host to connect
+    boost::mutex::scoped_lock connection_lock(connection_mutex_);
+    while(upstream_->NoConnections() && upstream_->Running())
+    {
+        upstream_->pending_first_condition()->wait(connection_lock);
+    }
+
+    // read from publishers
+    if (upstream_->Running())
+    {
+        upstream_->Read();
+    }
+}
+
+/*
+ * Re-publishes upstream message(s) downstream
+ *  - runs on the relay thread only, which keeps every publisher's order
+ *  - the encoded message is relayed as is (publisher id, sequence number and send
+ *    timestamp included), so subscribers downstream see the original publisher
+ *  - a message's receive to process latency ends once it is queued downstream
+ */
+void Broker::RelayMessages()
+{
+    ReceivedMessage received;
+
+    // wait until a message is read (false: exiting)
+    while(upstream_->WaitMessage(received))
+    {
+        MessageView view(received.bytes.empty() ? 0 : &received.bytes[0], received.bytes.size());
+        if (!view.IsValid())
+        {
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] Error: malformed message of " << received.bytes.size() << " bytes" << std::endl;
+            continue;
+        }
+
+        downstream_->Write(std::string(received.bytes.begin(), received.bytes.end()));
+        upstream_->MessageProcessed(received);
+    }
+}
+
+/*
+ * Takes a snapshot of both sides' metrics
+ *  - upstream: per publisher, downstream: per subscriber
+ */
+void Broker::CollectMetrics(MetricsSnapshot& snapshot)
+{
+    upstream_->CollectMetrics(snapshot);
+    downstream_->CollectMetrics(snapshot);
+}
@@ -0,0 +1,47 @@
+#ifndef BROKER_H
+#define BROKER_H
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include "communication.h"
+#include "message.h"
+#include "metrics.h"
+#include "options.h"
+
+/*
+ * Class representation for brokers
+ *  - subscribes upstream once (to pubs or other brokers) and re-publishes every
+ *    message, unchanged, to its own subscribers (subs or other brokers)
+ *  - upstream and downstream run on io threads of their own, a single relay
+ *    thread in between keeps each publisher's messages in order
+ */
+class Broker
+{
+    public:
+        Broker() : upstream_(new Communication),
+                   downstream_(new Communication) {}
+
+        void Launch(BrokerOptions opt);              // launches the broker
+        void GetMessages();                          // gets message(s) from upstream
+        void RelayMessages();                        // re-publishes message(s) downstream
+        void CollectMetrics(MetricsSnapshot& snapshot);
+        void Exit();                                 // provides a clean exit
+
+        // com accessors
+        boost::shared_ptr<Communication> upstream(){return upstream_;}
+        boost::shared_ptr<Communication> downstream(){return downstream_;}
+
+        // id mutator
+        void set_id(std::string id) {id_ = id;}
+
+
+    private:
+        std::string id_;
+        boost::shared_ptr<Communication> upstream_,    // subscriber side
+                                         downstream_;  // publisher side
+
+        boost::mutex connection_mutex_;
+        boost::thread relay_thread_;                   // runs RelayMessages
+};
+
+#endif // BROKER_H
@@ -15,9 +15,28 @@ void Communication::InitIoService()
               << "] Press <RETURN> to exit." << std::endl;
 }
 
+/*
+ * Initialises a pool of io_services for the connections
+ *  - @pool_size: the number of io_services, each one is run by a single pinned thread
+ *  - sockets are spread across the pool round-robin, so all handlers of a
+ *    connection run on the same thread; the shared io_service keeps accepting,
+ *    connecting and the posted pub/sub loops
+ */
+void Communication::InitIoServicePool(int pool_size)
+{
+    for (int i=0; i<pool_size; i++)
+    {
+        boost::shared_ptr<boost::asio::io_service> io_service(new boost::asio::io_service(1));
+        boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(*io_service));
+        io_services_.push_back(io_service);
+        works_.push_back(work);
+    }
+}
+
 /*
  * Launches the communication threads
  *  - @thread_count: the number of threads to be used
+ *  - adds one thread per pooled io_service
  */
 void Communication::LaunchThreads(int thread_count)
 {
@@ -27,6 +46,13 @@ void Communication::LaunchThreads(int thread_count)
         communication_threads_.create_thread(boost::bind(&Communication::Run,
                                                          this));
     }
+
+    for (unsigned i=0; i<io_services_.size(); i++)
+    {
+        communication_threads_.create_thread(boost::bind(&Communication::RunPooled,
+                                                         this,
+                                                         i));
+    }
 }
 
 /*
@@ -36,7 +62,7 @@ void Communication::LaunchThreads(int thread_count)
 void Communication::Accept(std::string port)
 {
     boost::shared_ptr<boost::asio::ip::tcp::acceptor> acceptor(new boost::asio::ip::tcp::acceptor(*io_service_));
-    boost::shared_ptr<boost::asio::ip::tcp::socket> sock(new boost::asio::ip::tcp::socket(*io_service_));
+    boost::shared_ptr<ClientConnection> client(new ClientConnection(NextIoService()));
 
     acceptor_ = acceptor;
 
@@ -54,10 +80,10 @@ void Communication::Accept(std::string port)
         std::cout << "[" << boost::this_thread::get_id()
                   << "] Listening on: " << endpoint << std::endl;
 
-        acceptor_->async_accept(*sock, boost::bind(&Communication::AddClient,
-                                                   this,
-                                                   boost::asio::placeholders::error(),
-                                                   sock));
+        acceptor_->async_accept(*client->socket, boost::bind(&Communication::AddClient,
+                                                             this,
+                                                             boost::asio::placeholders::error(),
+                                                             client));
     }
 
     // report any exceptions
@@ -69,84 +95,195 @@ void Communication::Accept(std::string port)
 }
 
 /*
- * Writes to the localhost
- *  - @str: the data to be writen
- *  - @length: the string length
+ * Sets up publishing to a multicast group
+ *  - @group, @port: the group's address and port
+ *  - @interface: the local address multicast is sent from (127.0.0.1 keeps it on loopback)
+ *  - @tcp_fanout: also write every message to the TCP subscribers
  */
-void Communication::Write(std::string str, int length)
+void Communication::EnableMulticast(std::string group, std::string port, std::string interface, bool tcp_fanout)
 {
-    // lock any "sockets_.size()" usage/modification
-    com_mutex_.lock();
+    try
+    {
+        multicast_endpoint_ = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(group),
+                                                             boost::lexical_cast<unsigned short>(port));
 
-    for (unsigned i=0; i<sockets_.size(); i++)
+        boost::shared_ptr<boost::asio::ip::udp::socket> sock(new boost::asio::ip::udp::socket(*io_service_,
+                                                                                              multicast_endpoint_.protocol()));
+        sock->set_option(boost::asio::ip::multicast::outbound_interface(boost::asio::ip::address_v4::from_string(interface)));
+        sock->set_option(boost::asio::ip::multicast::hops(1));
+        sock->set_option(boost::asio::ip::multicast::enable_loopback(true));
+
+        multicast_socket_ = sock;
+        is_tcp_fanout_ = tcp_fanout;
+
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Multicasting to: " << multicast_endpoint_ << std::endl;
+    }
+
+    // report any exceptions
+    catch (std::exception & ex)
     {
-        // send message through the sockets_
-        boost::asio::async_write(*sockets_[i],
-                                 boost::asio::buffer(str, length),
-                                 boost::bind(&Communication::WriteHandler,
-                                             this,
-                                             boost::asio::placeholders::error,
-                                             boost::asio::placeholders::bytes_transferred,
-                                             sockets_[i]));
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Exception: " << ex.what() << std::endl;
     }
+}
 
-    // unlock any "sockets_.size()" usage/modification
-    com_mutex_.unlock();
+/*
+ * Sets up publishing to a shared-memory ring, for subscribers on this host
+ *  - @name: the shared memory object name, given to the subs
+ *  - @slots, @slot_size: the ring's message count and largest message
+ *  - @tcp_fanout: also write every message to the TCP subscribers
+ */
+void Communication::EnableSharedRing(std::string name, boost::uint32_t slots, boost::uint32_t slot_size, bool tcp_fanout)
+{
+    try
+    {
+        shared_ring_.reset(new SharedRing(name, slots, slot_size));
+        is_tcp_fanout_ = tcp_fanout;
 
-    // report connection count
-    out_mutex_.lock();
-    std::cout << "[" << boost::this_thread::get_id()
-              <<  "] Connected sockets = " << sockets_.size() << std::endl;
-    out_mutex_.unlock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Writing to shared ring: " << name << std::endl;
+    }
+
+    // report any exceptions
+    catch (std::exception & ex)
+    {
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Exception: " << ex.what() << std::endl;
+    }
 }
 
 /*
- * Connects to specified server(s)
- *  - @servers_count: the number of servers to be connected to
- *  - @servers: a vector of Connection objects (for ip, port, pub_id)
+ * Sets up the publisher's journal
+ *  - @directory: the journal directory, reopened with its history if it exists
+ *  - @segment_size, @sync_every, @sync_interval_ms: see Journal
+ *  - returns the last sequence number journaled, to continue the numbering from
  */
-void Communication::Connect(int servers_count, std::vector<Connection> servers)
+boost::uint64_t Communication::EnableJournal(std::string directory, std::size_t segment_size,
+                                             std::size_t sync_every, int sync_interval_ms)
 {
-    // connect with the server(s)
-    for (int i=0; i<servers_count; i++)
+    try
     {
-        boost::shared_ptr<boost::asio::ip::tcp::socket> sock(new boost::asio::ip::tcp::socket(*io_service_));
+        journal_.reset(new Journal(directory, segment_size, sync_every, sync_interval_ms));
 
-        // get the pub from the options
-        Connection con = servers[i];
-        boost::shared_ptr<std::string> server_name(new std::string(con.pub_id));
-        boost::shared_ptr<std::string> server_ip(new std::string(con.ip));
-        boost::shared_ptr<std::string> server_port(new std::string(con.port));
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Journaling to: " << directory
+                  << " (last #" << journal_->last_sequence() << ")" << std::endl;
 
-        try
-        {
-            // try to connect
-            boost::asio::ip::tcp::resolver resolver(*io_service_);
-            boost::asio::ip::tcp::resolver::query query(con.ip, con.port);
-            boost::asio::ip::tcp::resolver::iterator iterator = resolver.resolve(query);
-            boost::asio::ip::tcp::endpoint endpoint = *iterator;
+        return journal_->last_sequence();
+    }
 
-            sock->async_connect(endpoint,
-                                boost::bind(&Communication::AddServer,
-                                            this,
-                                            boost::asio::placeholders::error(),
-                                            sock,
-                                            endpoint,
-                                            server_name,
-                                            server_ip,
-                                            server_port));
+    // report any exceptions
+    catch (std::exception & ex)
+    {
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Exception: " << ex.what() << std::endl;
+    }
+
+    return 0;
+}
+
+/*
+ * Writes to the localhost
+ *  - @message: the data to be writen, sent as one length-prefixed frame
+ *  - with a shared ring, the message is written once into it (from the publishing thread)
+ *  - with multicast, the frame is sent once to the group (from the publishing thread)
+ *  - TCP subscribers get it without tcp_fanout too, if neither of the above took it
+ *  - the message is appended to the journal, the frame kept in the replay ring
+ *  - the frame is encoded once and queued on every client connection, through its strand
+ *  - iterates a snapshot of the connected clients, no lock is taken
+ */
+void Communication::Write(const std::string& message)
+{
+    // refuse messages the subscribers would reject
+    if (message.size() > max_message_size_)
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Error: message of " << message.size()
+                  << " bytes exceeds the " << max_message_size_ << " bytes limit" << std::endl;
+        out_mutex_.unlock();
+        return;
+    }
+
+    boost::shared_ptr<const std::string> frame(new std::string(EncodeFrame(message)));
+    written_messages_.fetch_add(1, boost::memory_order_relaxed);
+
+    bool is_sent = false;
+
+    // write once to the shared ring (false if it does not fit a slot)
+    if (shared_ring_)
+    {
+        is_sent = shared_ring_->Write(message);
+    }
 
+    // send once to the multicast group
+    if (multicast_socket_)
+    {
+        boost::system::error_code ec;
+        multicast_socket_->send_to(boost::asio::buffer(*frame), multicast_endpoint_, 0, ec);
+
+        if (ec)
+        {
+            out_mutex_.lock();
             std::cout << "[" << boost::this_thread::get_id()
-                      << "] Connecting to: " << endpoint << std::endl;
+                      << "] Error: " << ec.message() << std::endl;
+            out_mutex_.unlock();
         }
+        is_sent = is_sent || !ec;
+    }
 
-        // catch any exception
-        catch (std::exception & ex)
+    MessageView view(message.data(), message.size());
+    boost::shared_ptr<const ClientList> clients;
+
+    // journal before the replay ring, so the journal is never behind it
+    if (journal_ && view.IsValid() && !journal_->Append(view.sequence(), view.timestamp_ns(), message))
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Error: message #" << view.sequence() << " does not fit a journal segment" << std::endl;
+        out_mutex_.unlock();
+    }
+
+    // keep the frame for replays; a subscriber is either replayed it or sees it live
+    replay_mutex_.lock();
+    if (replay_capacity_ > 0 && view.IsValid())
+    {
+        replay_.push_back(std::make_pair(view.sequence(), frame));
+        if (replay_.size() > replay_capacity_)
         {
-            std::cout << "[" << boost::this_thread::get_id()
-                      << "] Exception: " << ex.what() << std::endl;
+            replay_.pop_front();
         }
     }
+    clients = boost::atomic_load(&clients_);
+    replay_mutex_.unlock();
+
+    if (is_tcp_fanout_ || !is_sent)
+    {
+        pending_frames_.fetch_add(clients->size(), boost::memory_order_relaxed);
+    }
+
+    for (unsigned i=0; i<clients->size() && (is_tcp_fanout_ || !is_sent); i++)
+    {
+        (*clients)[i]->strand.post(boost::bind(&Communication::QueueFrame,
+                                               this,
+                                               (*clients)[i],
+                                               frame));
+    }
+}
+
+/*
+ * Connects to specified server(s)
+ *  - @servers_count: the number of servers to be connected to
+ *  - @servers: a vector of Connection objects (for ip, port, pub_id)
+ *  - failed connections are retried with a jittered exponential backoff
+ */
+void Communication::Connect(int servers_count, std::vector<Connection> servers)
+{
+    for (int i=0; i<servers_count; i++)
+    {
+        StartConnect(Connector(servers[i]));
+    }
 }
 
 /*
@@ -170,18 +307,17 @@ void Communication::Read()
             if (!is_reading_[i])
             {
                 boost::asio::async_read(*sockets_[i],
-                                        boost::asio::buffer(*buf_[i], 30),
-                                        boost::bind(&Communication::ReadHandler,
+                                        boost::asio::buffer(*buf_[i]),
+                                        boost::bind(&Communication::ReadHeaderHandler,
                                                     this,
                                                     boost::asio::placeholders::error,
                                                     boost::asio::placeholders::bytes_transferred,
                                                     buf_[i],
                                                     servers_[i],
-                                                    sockets_[i]));
+                                                    sockets_[i],
+                                                    publisher_caches_[i]));
                 is_reading_[i] = true;
-                break;
             }
-
         }
 
         is_pending_add_ = true;
@@ -195,335 +331,2054 @@ void Communication::Read()
  */
 void Communication::PrepareForExit(std::string role)
 {
+    if (metrics_)
+    {
+        metrics_->Stop();
+    }
+
     if (role == "server")
     {
         boost::system::error_code ec;
         acceptor_->close(ec);
     }
 
+    boost::shared_ptr<const ClientList> clients = boost::atomic_load(&clients_);
+    for (unsigned i=0; i<clients->size(); i++)
+    {
+        ReportClient((*clients)[i]);
+
+        boost::system::error_code ec;
+        (*clients)[i]->socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        (*clients)[i]->socket->close(ec);
+    }
+
+    if (multicast_socket_)
+    {
+        boost::system::error_code ec;
+        multicast_socket_->close(ec);
+    }
+
+    for (unsigned i=0; i<receivers_.size(); i++)
+    {
+        boost::system::error_code ec;
+        receivers_[i]->socket.close(ec);
+    }
+
+    reconnect_mutex_.lock();
+    for (std::map<std::string, boost::shared_ptr<ServerConnector> >::iterator it = connectors_.begin();
+         it != connectors_.end(); ++it)
+    {
+        boost::system::error_code ec;
+        it->second->timer.cancel(ec);
+    }
+    reconnect_mutex_.unlock();
+
+    // the read handlers remove the closed sockets under com_mutex_
+    com_mutex_.lock();
     for (unsigned i=0; i<sockets_.size(); i++)
     {
         boost::system::error_code ec;
-        sockets_[i]->cancel();
+        sockets_[i]->cancel(ec);
         sockets_[i]->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
         sockets_[i]->close(ec);
     }
+    com_mutex_.unlock();
 
     // make sure all threads join
     work_.reset();
     io_service_->stop();
+    works_.clear();
+    for (unsigned i=0; i<io_services_.size(); i++)
+    {
+        io_services_[i]->stop();
+    }
     pending_first_condition_->notify_all();
 
     if (role == "client")
     {
         is_pending_add_ = false;
-        is_set_message_ = true;
         pending_add_condition_.notify_all();
+
+        boost::mutex::scoped_lock queue_lock(message_queue_mutex_);
         setting_message_condition_->notify_all();
-        getting_message_condition_->notify_all();
     }
 
     communication_threads_.join_all();
+
+    // release any unprocessed messages
+    ReceivedMessage message;
+    while (messages_ && PopMessage(message)) {}
 }
 
 /*
- * Reports that no server is now connected
+ * Sets up the metrics export
+ *  - @id: the pub/sub id, labels every metric
+ *  - @port: serves GET /metrics on localhost (empty: no HTTP)
+ *  - @json_file: dumps JSON every @json_interval_ms (empty: no dump)
+ *  - @collect: fills the snapshots, CollectMetrics if empty
  */
-void Communication::NoServerReport()
+void Communication::EnableMetrics(std::string id, std::string port, std::string json_file, int json_interval_ms,
+                                  MetricsExporter::Collector collect)
 {
-        out_mutex_.lock();
-        std::cout << "\n[" << boost::this_thread::get_id()
-                  << "] All publishers disconnected - press <RETURN> to exit \n" << std::endl;
-        out_mutex_.unlock();
-}
-
+    id_ = id;
+    if (collect.empty())
+    {
+        collect = boost::bind(&Communication::CollectMetrics,
+                              this,
+                              _1);
+    }
+    metrics_.reset(new MetricsExporter(*io_service_, collect));
 
+    if (!port.empty())
+    {
+        metrics_->Listen(port);
+    }
 
-// ----- Private functions -----
+    if (!json_file.empty() && json_interval_ms > 0)
+    {
+        metrics_->StartDump(json_file, json_interval_ms);
+    }
+}
 
 /*
- * Runs the io_service
+ * Takes a snapshot of the process and connection metrics
+ *  - pub: per subscriber connection, sub: per publisher
  */
-void Communication::Run()
+void Communication::CollectMetrics(MetricsSnapshot& snapshot)
 {
-    // loop until the application is stopped manually
-    while (Running())
+    MetricLabels labels = Labels("id", id_);
+
+    // pub
+    if (acceptor_)
     {
-        try
-        {
-            boost::system::error_code ec;
-            io_service_->run(ec);
+        boost::shared_ptr<const ClientList> clients = boost::atomic_load(&clients_);
 
-            // report any error
-            if (ec)
-            {
-                out_mutex_.lock();
-                std::cout << "[" << boost::this_thread::get_id()
-                          << "] Error: " << ec << std::endl;
-                out_mutex_.unlock();
-            }
+        snapshot.Add("pubsub_published_messages_total", "counter", labels, written_messages_.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_written_frames_total", "counter", labels, written_frames_.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_written_bytes_total", "counter", labels, written_bytes_.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_pending_frames", "gauge", labels, pending_frames_.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_subscribers", "gauge", labels, clients->size());
+        snapshot.Add("pubsub_write_latency_seconds", labels, write_latency_);
+
+        for (unsigned i=0; i<clients->size(); i++)
+        {
+            const ClientConnection& client = *(*clients)[i];
+            MetricLabels client_labels = Labels(labels, "subscriber", client.name);
+
+            snapshot.Add("pubsub_subscriber_frames_total", "counter", client_labels, client.sent_frames.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_bytes_total", "counter", client_labels, client.sent_bytes.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_dropped_total", "counter", client_labels, client.dropped_frames.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_conflated_total", "counter", client_labels, client.conflated_frames.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_filtered_total", "counter", client_labels, client.filtered_frames.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_pauses_total", "counter", client_labels, client.pauses.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_queued_bytes", "gauge", client_labels, client.queued_bytes.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_max_queued_bytes", "gauge", client_labels, client.max_queued_bytes.load(boost::memory_order_relaxed));
+            snapshot.Add("pubsub_subscriber_write_latency_seconds", client_labels, client.write_latency);
         }
+        return;
+    }
 
-        // catch any exception
-        catch (std::exception & ex)
+    // sub
+    snapshot.Add("pubsub_queue_depth", "gauge", labels, queue_depth());
+    snapshot.Add("pubsub_max_queue_depth", "gauge", labels, max_queue_depth());
+    snapshot.Add("pubsub_dropped_messages_total", "counter", labels, dropped_messages());
+    snapshot.Add("pubsub_missing_messages_total", "counter", labels, missing_messages());
+    snapshot.Add("pubsub_duplicate_messages_total", "counter", labels, duplicate_messages());
+    snapshot.Add("pubsub_recovered_messages_total", "counter", labels, recovered_messages());
+
+    publishers_mutex_.lock();
+    for (std::map<std::string, boost::shared_ptr<PublisherState> >::const_iterator it = publishers_.begin();
+         it != publishers_.end(); ++it)
+    {
+        const PublisherState& publisher = *it->second;
+        if (publisher.messages.load(boost::memory_order_relaxed) == 0)
         {
-            out_mutex_.lock();
-            std::cout << "[" << boost::this_thread::get_id()
-                      << "] Exception: " << ex.what() << std::endl;
-            out_mutex_.unlock();
+            continue;
         }
+
+        MetricLabels publisher_labels = Labels(labels, "publisher", it->first);
+        snapshot.Add("pubsub_received_messages_total", "counter", publisher_labels,
+                     publisher.messages.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_received_bytes_total", "counter", publisher_labels,
+                     publisher.bytes.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_publish_to_receive_seconds", publisher_labels, publisher.latency->publish_to_receive);
+        snapshot.Add("pubsub_receive_to_process_seconds", publisher_labels, publisher.latency->receive_to_process);
     }
+    publishers_mutex_.unlock();
+
+    reconnect_mutex_.lock();
+    for (std::map<std::string, boost::shared_ptr<ServerConnector> >::const_iterator it = connectors_.begin();
+         it != connectors_.end(); ++it)
+    {
+        MetricLabels publisher_labels = Labels(labels, "publisher", it->first);
+        snapshot.Add("pubsub_connect_attempts_total", "counter", publisher_labels,
+                     it->second->connect_attempts.load(boost::memory_order_relaxed));
+        snapshot.Add("pubsub_connections_total", "counter", publisher_labels,
+                     it->second->connections.load(boost::memory_order_relaxed));
+    }
+    reconnect_mutex_.unlock();
+
+    com_mutex_.lock();
+    snapshot.Add("pubsub_connected_publishers", "gauge", labels, sockets_.size());
+    com_mutex_.unlock();
 }
 
 /*
- * Adds a client, listens for another
+ * Joins a multicast group and starts receiving from it
+ *  - @server: the configured publisher (or broker) id, whose topic filter applies
+ *  - @group, @port: the group's address and port
+ *  - @interface: the local address to join on (127.0.0.1 for loopback)
  */
-void Communication::AddClient(const boost::system::error_code& error,
-                              boost::shared_ptr<boost::asio::ip::tcp::socket> sock)
+void Communication::JoinMulticast(std::string server, std::string group, std::string port, std::string interface)
 {
-    if (!error)
+    boost::shared_ptr<MulticastReceiver> receiver(new MulticastReceiver(NextIoService()));
+    receiver->publishers.connection = FindPublisher(server, true);
+    receiver->publishers.is_recoverable = true;
+
+    try
     {
-        // lock any "sockets_.size()" usage/modification
-        com_mutex_.lock();
+        boost::asio::ip::address group_address = boost::asio::ip::address::from_string(group);
+        boost::asio::ip::udp::endpoint endpoint(group_address, boost::lexical_cast<unsigned short>(port));
 
-        out_mutex_.lock();
-        std::cout << "\n[" << boost::this_thread::get_id()
-                  << "]  >> Subscriber connected \n" << std::endl;
-        out_mutex_.unlock();
+        receiver->socket.open(endpoint.protocol());
+        receiver->socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+        receiver->socket.bind(endpoint);
+        receiver->socket.set_option(boost::asio::ip::multicast::join_group(group_address.to_v4(),
+                                                                           boost::asio::ip::address_v4::from_string(interface)));
 
-        // keep subscriber record
-        sockets_.push_back(sock);
+        com_mutex_.lock();
+        receivers_.push_back(receiver);
+        com_mutex_.unlock();
 
-        // listen for the next subscriber, use another socket
-        boost::shared_ptr<boost::asio::ip::tcp::socket> next_sock(new boost::asio::ip::tcp::socket(*io_service_));
-        acceptor_->async_accept(*next_sock,
-                               boost::bind(&Communication::AddClient,
-                                           this,
-                                           boost::asio::placeholders::error(),
-                                           next_sock));
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Joined multicast group: " << endpoint << std::endl;
 
-        // unlock any "sockets_.size()" usage/modification
-        com_mutex_.unlock();
+        StartReceive(receiver);
     }
 
-    // report any errors
-    else
+    // report any exceptions
+    catch (std::exception & ex)
     {
-        out_mutex_.lock();
         std::cout << "[" << boost::this_thread::get_id()
-                  << "] Error: " << error << std::endl;
-        out_mutex_.unlock();
+                  << "] Exception: " << ex.what() << std::endl;
     }
 }
 
 /*
- * Handles asyncronous write operations
- *  - reports message deliverry for each client's socket
- *  - removes and reports any disconnected clients
+ * Starts reading a publisher's shared-memory ring
+ *  - @server: the configured publisher id, whose topic filter applies
+ *  - @name: the shared memory object name set by the publisher
+ *  - uses a thread of its own, which sleeps on the ring when idle
  */
-void Communication::WriteHandler(const boost::system::error_code& error,
-                             std::size_t bytes_transferred,
-                             boost::shared_ptr<boost::asio::ip::tcp::socket> soc)
+void Communication::JoinSharedRing(std::string server, std::string name)
 {
-    com_mutex_.lock();
+    communication_threads_.create_thread(boost::bind(&Communication::ReadSharedRing,
+                                                     this,
+                                                     FindPublisher(server, true),
+                                                     name));
+}
 
-    // report successful delivery
-    if(bytes_transferred == 30)
-    {
-        out_mutex_.lock();
-        std::cout << "[" << boost::this_thread::get_id()
-                  <<  "] ---------- message sent ----------" << std::endl;
-        out_mutex_.unlock();
-    }
+/*
+ * Creates the queue between the network reads and the message processing
+ *  - @capacity: the most messages kept, further messages are dropped
+ */
+void Communication::InitMessageQueue(std::size_t capacity)
+{
+    messages_.reset(new boost::lockfree::queue<ReceivedMessage*>(capacity));
+}
 
-    // remove client
-    else
+/*
+ * Takes the oldest read message, if any
+ *  - never blocks, safe for any number of processing threads
+ *  - @message: its bytes are swapped with the encoded message, read them through a MessageView
+ */
+bool Communication::PopMessage(ReceivedMessage& message)
+{
+    ReceivedMessage* next = 0;
+    if (!messages_->pop(next))
     {
-        soc->close();
-
-        // remove disconnected clients' socket
-        for (unsigned i=0; i<sockets_.size(); i++)
-        {
-            if (!sockets_[i]->is_open())
-            {
-                sockets_.erase(sockets_.begin()+i);
-
-                // report disconnection
-                out_mutex_.lock();
-                std::cout << "\n[" << boost::this_thread::get_id()
-                          <<  "] << Subscriber disconnected \n" << std::endl;
-                out_mutex_.unlock();
-            }
-        }
+        return false;
     }
 
-    com_mutex_.unlock();
+    message.bytes.swap(next->bytes);
+    message.received = next->received;
+    message.latency.swap(next->latency);
+    delete next;
+    queue_depth_.fetch_sub(1, boost::memory_order_relaxed);
+
+    return true;
 }
 
 /*
- * Connects to a server
- *  - on success: adds all server related elements
- *  - on failure: retries
+ * Takes the oldest read message, waits for one if there is none
+ *  - returns false (no message taken) once exiting
+ *  - a waiter registers in waiting_processors_ before checking the queue a last time, and
+ *    PushMessage notifies under message_queue_mutex_ if it sees one: no wake-up is lost
  */
-void Communication::AddServer(const boost::system::error_code& error,
-                              boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
-                              boost::asio::ip::tcp::endpoint endpoint,
-                              boost::shared_ptr<std::string> server,
-                              boost::shared_ptr<std::string> ip,
-                              boost::shared_ptr<std::string> port)
+bool Communication::WaitMessage(ReceivedMessage& message)
 {
-    // remote host is now connected
-    if (!error)
+    if (!Running())
     {
-        // lock any "sockets_.size()" usage/modification
-        com_mutex_.lock();
+        return false;
+    }
+    if (PopMessage(message))
+    {
+        return true;
+    }
 
-        // add a pub, along with all related pub elements
-        sockets_.push_back(soc);
-        servers_.push_back(server);
-        boost::shared_ptr< boost::array<char, 30> > new_buf_ptr(new boost::array<char, 30>);
-        new_buf_ptr->assign(0);
-        buf_.push_back(new_buf_ptr);
-        is_reading_.push_back(false);
-        Connection new_server;
-        new_server.pub_id = *server;
-        new_server.ip = *ip;
-        new_server.port = *port;
-        connections_.push_back(new_server);
+    boost::mutex::scoped_lock queue_lock(message_queue_mutex_);
+    waiting_processors_.fetch_add(1, boost::memory_order_seq_cst);
 
-        // report successful connection
+    bool is_taken = false;
+    while (Running() && !(is_taken = PopMessage(message)))
+    {
+        setting_message_condition_->wait(queue_lock);
+    }
+
+    waiting_processors_.fetch_sub(1, boost::memory_order_relaxed);
+    return is_taken;
+}
+
+/*
+ * Records the receive to process latency of a message taken with PopMessage
+ *  - called by the processing threads once done with it
+ */
+void Communication::MessageProcessed(const ReceivedMessage& message)
+{
+    if (message.latency)
+    {
+        message.latency->receive_to_process.Record(boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                                                       boost::chrono::steady_clock::now() - message.received).count());
+    }
+}
+
+/*
+ * Returns the end-to-end latency histograms, per publisher
+ */
+std::map<std::string, boost::shared_ptr<PublisherLatency> > Communication::latencies()
+{
+    boost::mutex::scoped_lock publishers_lock(publishers_mutex_);
+
+    std::map<std::string, boost::shared_ptr<PublisherLatency> > latencies;
+    for (std::map<std::string, boost::shared_ptr<PublisherState> >::const_iterator it = publishers_.begin();
+         it != publishers_.end(); ++it)
+    {
+        if (it->second->messages.load(boost::memory_order_relaxed) > 0)
+        {
+            latencies[it->first] = it->second->latency;
+        }
+    }
+    return latencies;
+}
+
+/*
+ * Reports the end-to-end latency percentiles of every publisher
+ */
+void Communication::ReportLatency()
+{
+    std::map<std::string, boost::shared_ptr<PublisherLatency> > latencies = this->latencies();
+
+    out_mutex_.lock();
+    if (latencies.empty())
+    {
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Latency: no messages received" << std::endl;
+    }
+    for (std::map<std::string, boost::shared_ptr<PublisherLatency> >::const_iterator it = latencies.begin();
+         it != latencies.end(); ++it)
+    {
+        ReportPercentiles(it->first, "publish to receive", it->second->publish_to_receive);
+        ReportPercentiles(it->first, "receive to process", it->second->receive_to_process);
+    }
+    out_mutex_.unlock();
+}
+
+/*
+ * Reports that no server is now connected
+ */
+void Communication::NoServerReport()
+{
         out_mutex_.lock();
         std::cout << "\n[" << boost::this_thread::get_id()
-                  << "] >> Connection to " << *server
-                  << " at " << endpoint << " succeded \n" << std::endl;
+                  << "] All publishers disconnected - press <RETURN> to exit \n" << std::endl;
         out_mutex_.unlock();
+}
 
-        // let the read operations begin/continue
-        is_pending_add_ = false;
-        pending_add_condition_.notify_one();
 
-        // unlock any "sockets_.size()" usage/modification
-        com_mutex_.unlock();
 
-        // inform on first connection
-        if (sockets_.size() == 1)
+// ----- Private functions -----
+
+/*
+ * Runs the io_service
+ */
+void Communication::Run()
+{
+    // loop until the application is stopped manually
+    while (Running())
+    {
+        try
         {
-            pending_first_condition_->notify_one();
+            boost::system::error_code ec;
+            io_service_->run(ec);
+
+            // report any error
+            if (ec)
+            {
+                out_mutex_.lock();
+                std::cout << "[" << boost::this_thread::get_id()
+                          << "] Error: " << ec << std::endl;
+                out_mutex_.unlock();
+            }
+        }
+
+        // catch any exception
+        catch (std::exception & ex)
+        {
+            out_mutex_.lock();
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] Exception: " << ex.what() << std::endl;
+            out_mutex_.unlock();
+        }
+    }
+}
+
+/*
+ * Runs a pooled io_service on a thread pinned to one core
+ *  - @index: the io_service index in the pool
+ */
+void Communication::RunPooled(unsigned index)
+{
+    // pin this thread, wrap around when the pool outnumbers the cores
+    unsigned cores = boost::thread::hardware_concurrency();
+    if (cores > 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(index % cores, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+
+    // loop until the application is stopped manually
+    while (Running())
+    {
+        try
+        {
+            boost::system::error_code ec;
+            io_services_[index]->run(ec);
+
+            // report any error
+            if (ec)
+            {
+                out_mutex_.lock();
+                std::cout << "[" << boost::this_thread::get_id()
+                          << "] Error: " << ec << std::endl;
+                out_mutex_.unlock();
+            }
+        }
+
+        // catch any exception, a handler's failure must not end the process
+        catch (std::exception & ex)
+        {
+            out_mutex_.lock();
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] Exception: " << ex.what() << std::endl;
+            out_mutex_.unlock();
         }
     }
+}
+
+/*
+ * Picks the io_service for a new socket
+ *  - round-robin over the pool, the shared io_service if there is no pool
+ */
+boost::asio::io_service& Communication::NextIoService()
+{
+    if (io_services_.empty())
+    {
+        return *io_service_;
+    }
 
-    // remote host is not connected yet
-    else if (error.message() == "Connection refused")
+    unsigned next = next_io_service_.fetch_add(1, boost::memory_order_relaxed);
+    return *io_services_[next % io_services_.size()];
+}
+
+/*
+ * Adds a client, listens for another
+ */
+void Communication::AddClient(const boost::system::error_code& error,
+                              boost::shared_ptr<ClientConnection> client)
+{
+    if (!error)
     {
-        // try again
-        usleep(100000);
-        soc.reset(new boost::asio::ip::tcp::socket(*io_service_));
-        soc->async_connect(endpoint,
-                           boost::bind(&Communication::AddServer,
-                                       this,
-                                       boost::asio::placeholders::error(),
-                                       soc,
-                                       endpoint,
-                                       server,
-                                       ip,
-                                       port));
+        boost::system::error_code ec;
+        client->name = boost::lexical_cast<std::string>(client->socket->remote_endpoint(ec));
+
+        out_mutex_.lock();
+        std::cout << "\n[" << boost::this_thread::get_id()
+                  << "]  >> Subscriber connected \n" << std::endl;
+        out_mutex_.unlock();
+
+        // wait for its resume request before adding it to the fan-out
+        client->strand.post(boost::bind(&Communication::ReadControl,
+                                        this,
+                                        client));
+
+        // listen for the next subscriber, use another connection
+        boost::shared_ptr<ClientConnection> next_client(new ClientConnection(NextIoService()));
+        acceptor_->async_accept(*next_client->socket,
+                               boost::bind(&Communication::AddClient,
+                                           this,
+                                           boost::asio::placeholders::error(),
+                                           next_client));
     }
 
-    else // report error
+    // report any errors
+    else
     {
         out_mutex_.lock();
         std::cout << "[" << boost::this_thread::get_id()
-                  << "] Error: " << error.message() << std::endl;
+                  << "] Error: " << error << std::endl;
         out_mutex_.unlock();
     }
 }
 
 /*
- * Handles asyncronous read operations
- *  - sets message_ from server(s)
- *  - removes any disconnected servers
+ * Reads the next control request of a client
+ *  - runs in the client's strand
  */
-void Communication::ReadHandler(const boost::system::error_code& error,
-                                std::size_t bytes_transferred,
-                                boost::shared_ptr <boost::array<char, 30> > buffer,
-                                boost::shared_ptr <std::string> server_name,
-                                boost::shared_ptr<boost::asio::ip::tcp::socket> soc)
+void Communication::ReadControl(boost::shared_ptr<ClientConnection> client)
 {
-    com_mutex_.lock();
+    client->request.resize(kFrameHeaderSize);
+    boost::asio::async_read(*client->socket,
+                            boost::asio::buffer(client->request),
+                            client->strand.wrap(boost::bind(&Communication::ControlHeaderHandler,
+                                                            this,
+                                                            boost::asio::placeholders::error,
+                                                            boost::asio::placeholders::bytes_transferred,
+                                                            client)));
+}
 
-    // successful read
-    if (bytes_transferred == 30)
+/*
+ * Handles the frame header of a client's control request
+ *  - runs in the client's strand
+ */
+void Communication::ControlHeaderHandler(const boost::system::error_code& error,
+                                         std::size_t bytes_transferred,
+                                         boost::shared_ptr<ClientConnection> client)
+{
+    std::size_t payload_size = 0;
+
+    if (!error && bytes_transferred == kFrameHeaderSize &&
+        DecodeFrameHeader(&client->request[0], kMaxControlSize, payload_size) &&
+        payload_size > 0)
+    {
+        client->request.resize(payload_size);
+        boost::asio::async_read(*client->socket,
+                                boost::asio::buffer(client->request),
+                                client->strand.wrap(boost::bind(&Communication::ControlHandler,
+                                                                this,
+                                                                boost::asio::placeholders::error,
+                                                                boost::asio::placeholders::bytes_transferred,
+                                                                client)));
+    }
+
+    else
+    {
+        RejectClient(client);
+    }
+}
+
+/*
+ * Handles a client's control request, then reads the next one
+ *  - runs in the client's strand
+ *  - the first resume request adds the client to the fan-out
+ *  - subscriptions update the client's topic filter
+ *  - replay requests re-send the messages it lost on multicast or the shared ring
+ */
+void Communication::ControlHandler(const boost::system::error_code& error,
+                                   std::size_t /* bytes_transferred */,
+                                   boost::shared_ptr<ClientConnection> client)
+{
+    if (error)
+    {
+        RejectClient(client);
+        return;
+    }
+
+    switch (client->request[0])
     {
-        boost::mutex::scoped_lock message_lock(message_mutex_);
+        case kResumeControl:
+            if (client->is_resumed || client->is_catching_up || client->request.size() != kResumeRequestSize)
+            {
+                RejectClient(client);
+                return;
+            }
+            Resume(client);
+            break;
 
-        // let an unread message be read
-        while (!is_picked_message_)
+        case kSubscribeControl:
+        case kUnsubscribeControl:
         {
-            getting_message_condition_->wait(message_lock);
+            std::string pattern(client->request.begin() + 1, client->request.end());
+            std::vector<std::string>::iterator it = std::find(client->subscriptions.begin(),
+                                                              client->subscriptions.end(),
+                                                              pattern);
+            if (client->request[0] == kSubscribeControl && it == client->subscriptions.end())
+            {
+                client->subscriptions.push_back(pattern);
+            }
+            else if (client->request[0] == kUnsubscribeControl && it != client->subscriptions.end())
+            {
+                client->subscriptions.erase(it);
+            }
+            client->is_filtered = true;
+
+            if (!pattern.empty())
+            {
+                out_mutex_.lock();
+                std::cout << "[" << boost::this_thread::get_id()
+                          << "] Subscriber " << client->name
+                          << (client->request[0] == kSubscribeControl ? " subscribed to " : " unsubscribed from ")
+                          << pattern << std::endl;
+                out_mutex_.unlock();
+            }
+            break;
         }
 
-        // write message_ from buffer
-        message_ = buffer->data();
-        message_ = message_.substr(0, 30);
+        case kReplayControl:
+            if (client->request.size() != kReplayRequestSize)
+            {
+                RejectClient(client);
+                return;
+            }
+            // a catch-up still to finish sends these messages anyway
+            if (client->is_resumed)
+            {
+                Replay(client);
+            }
+            break;
 
-        // clear the read buffer
-        buffer->assign(0);
+        default:
+            RejectClient(client);
+            return;
+    }
 
-        is_picked_message_ = false;
-        is_set_message_ = true;
-        setting_message_condition_->notify_one();
+    // the resume or a replay may have dropped a slow client
+    if (client->socket->is_open())
+    {
+        ReadControl(client);
+    }
+}
 
-        // async_read next message on this server
-        boost::asio::async_read(*soc,
-                                boost::asio::buffer(*buffer, 30),
-                                boost::bind(&Communication::ReadHandler,
-                                            this,
-                                            boost::asio::placeholders::error,
-                                            boost::asio::placeholders::bytes_transferred,
-                                            buffer,
-                                            server_name,
-                                            soc));
+/*
+ * Resumes a client from its resume request
+ *  - runs in the client's strand
+ *  - works out where to resume from, then starts the catch-up
+ */
+void Communication::Resume(boost::shared_ptr<ClientConnection> client)
+{
+    boost::uint64_t next_sequence;
+    boost::int64_t since_ns;
+    DecodeResumeRequest(&client->request[0], next_sequence, since_ns);
+
+    // catching up on a period needs the journal's time index
+    if (next_sequence == 0 && since_ns > 0 && journal_)
+    {
+        next_sequence = journal_->SequenceAt(since_ns);
     }
 
-    else  // server is disconnected and will be removed
+    // nothing kept to replay (e.g. a broker's downstream): live messages only
+    if (replay_capacity_ == 0 && !journal_)
     {
-        out_mutex_.lock();
-        std::cout << "\n[" << boost::this_thread::get_id()
-                  << "] << " << *server_name << " is now disconnected \n" << std::endl;
-        out_mutex_.unlock();
+        next_sequence = 0;
+    }
 
+    // a subscriber ahead of this publisher saw an earlier run of it, start over
+    replay_mutex_.lock();
+    boost::uint64_t last_sequence = replay_.empty() ? 0 : replay_.back().first;
+    replay_mutex_.unlock();
+    if (journal_)
+    {
+        last_sequence = std::max(last_sequence, journal_->last_sequence());
+    }
+    if (next_sequence > last_sequence + 1)
+    {
+        next_sequence = 1;
+    }
 
-        // close this socket
-        soc->close();
+    client->resume_sequence = next_sequence;
+    client->caught_up_sequence = (next_sequence > 0) ? next_sequence - 1 : 0;
+    client->is_catching_up = true;
+    CatchUp(client);
+}
 
-        for (unsigned i=0; i<sockets_.size(); i++)
+/*
+ * Queues the next part of a client's catch-up
+ *  - runs in the client's strand, from Resume, then from WriteHandler after each write
+ *  - copies from the journal a batch at a time, and only while less than the low
+ *    watermark is queued: the catch-up streams at the client's pace and never holds
+ *    more than that (plus a batch)
+ *  - reads at most kCatchUpStepSize messages per call, then posts the rest, so a
+ *    filter rejecting most of the journal does not hold up the strand either
+ *  - once the replay ring holds the rest, queues it and adds the client to the
+ *    fan-out; holding replay_mutex_ for that leaves no gap in between
+ *  - only the topics the client subscribed to are replayed
+ */
+void Communication::CatchUp(boost::shared_ptr<ClientConnection> client)
+{
+    // disconnected meanwhile
+    if (!client->socket->is_open())
+    {
+        return;
+    }
+
+    bool is_replaying = (client->resume_sequence > 0);
+    std::size_t budget = std::max<std::size_t>(low_watermark_, 1),
+                queued = 0,
+                read = 0;
+
+    // copy from the mapped journal, the publisher keeps appending meanwhile
+    while (is_replaying && journal_ && journal_->last_sequence() > client->caught_up_sequence &&
+           client->queued_bytes < budget && read < kCatchUpStepSize)
+    {
+        std::vector<std::string> frames;
+        boost::uint64_t last_read = journal_->Read(client->caught_up_sequence + 1,
+                                                   std::min(kCatchUpBatchSize, kCatchUpStepSize - read),
+                                                   frames,
+                                                   kFrameHeaderSize);
+        if (last_read == 0)
         {
-            // find the closed socket
-            if (!sockets_[i]->is_open())
+            break;
+        }
+        read += frames.size();
+
+        for (unsigned i=0; i<frames.size(); i++)
+        {
+            if (IsSubscribed(client, frames[i].data() + kFrameHeaderSize, frames[i].size() - kFrameHeaderSize))
             {
-                // try to reconnect to this server
-                std::vector<Connection> disconnected_server;
-                disconnected_server.push_back(connections_[i]);
-                Connect(1, disconnected_server);
-
-                // erase all server related elements
-                sockets_.erase(sockets_.begin()+i);
-                servers_.erase(servers_.begin()+i);
-                buf_.erase(buf_.begin()+i);
-                is_reading_.erase(is_reading_.begin()+i);
-
-                break;
+                EncodeFrameHeader(&frames[i][0], frames[i].size() - kFrameHeaderSize);
+                boost::shared_ptr<std::string> frame(new std::string);
+                frame->swap(frames[i]);
+                client->queue.push_back(frame);
+                client->queued_bytes += frame->size();
+                queued++;
             }
         }
+        client->caught_up_sequence = last_read;
+    }
 
-        // check if all servers are disconnected
-        if (sockets_.size() == 0)
+    // the replay ring must take over where the journal stopped (or has nothing more)
+    bool is_joined = false;
+    if (client->queued_bytes < budget)
+    {
+        boost::mutex::scoped_lock replay_lock(replay_mutex_);
+        if (!is_replaying || !journal_ || replay_.empty() || replay_.front().first <= client->caught_up_sequence + 1 ||
+            journal_->last_sequence() <= client->caught_up_sequence)
         {
-            // report for waiting on <RETURN> keystroke
-            NoServerReport();
+            for (ReplayRing::const_iterator it = replay_.begin(); it != replay_.end() && is_replaying; ++it)
+            {
+                if (it->first > client->caught_up_sequence &&
+                    IsSubscribed(client, it->second->data() + kFrameHeaderSize, it->second->size() - kFrameHeaderSize))
+                {
+                    client->queue.push_back(it->second);
+                    client->queued_bytes += it->second->size();
+                    queued++;
+                }
+            }
+            RegisterClient(client);
+            client->is_resumed = true;
+            client->is_catching_up = false;
+            is_joined = true;
         }
     }
 
-    com_mutex_.unlock();
+    client->replayed += queued;
+    pending_frames_.fetch_add(queued, boost::memory_order_relaxed);
+    if (client->queued_bytes > client->max_queued_bytes.load(boost::memory_order_relaxed))
+    {
+        client->max_queued_bytes.store(client->queued_bytes, boost::memory_order_relaxed);
+    }
+
+    if (is_joined)
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Subscriber resumed from #" << client->resume_sequence
+                  << ", replaying " << client->replayed << " message(s)" << std::endl;
+        out_mutex_.unlock();
+    }
+
+    if (!client->is_writing)
+    {
+        // nothing to send yet (all filtered, or appended meanwhile): read on after the other handlers
+        if (client->queue.empty() && client->is_catching_up)
+        {
+            client->strand.post(boost::bind(&Communication::CatchUp, this, client));
+        }
+        else if (!client->queue.empty())
+        {
+            StartWrite(client);
+        }
+    }
 }
 
+/*
+ * Re-sends a range of messages from the replay ring, for a replay request
+ *  - runs in the client's strand, once the client is resumed
+ *  - the messages no longer in the ring are not sent
+ *  - queued like live messages: filtered by topic, subject to the slow consumer policy
+ */
+void Communication::Replay(boost::shared_ptr<ClientConnection> client)
+{
+    boost::uint64_t first_sequence;
+    boost::uint64_t last_sequence;
+    DecodeReplayRequest(&client->request[0], first_sequence, last_sequence);
+
+    std::vector< boost::shared_ptr<const std::string> > frames;
+    replay_mutex_.lock();
+    if (!replay_.empty() && first_sequence <= last_sequence)
+    {
+        // the ring holds consecutive sequence numbers: start from the first one's offset
+        std::size_t offset = (first_sequence > replay_.front().first) ? first_sequence - replay_.front().first : 0;
+        ReplayRing::const_iterator it = replay_.begin() + std::min<std::size_t>(offset, replay_.size());
+        while (it != replay_.begin() && (it - 1)->first >= first_sequence)
+        {
+            --it;
+        }
+        for (; it != replay_.end() && it->first <= last_sequence; ++it)
+        {
+            if (it->first >= first_sequence)
+            {
+                frames.push_back(it->second);
+            }
+        }
+    }
+    replay_mutex_.unlock();
+
+    pending_frames_.fetch_add(frames.size(), boost::memory_order_relaxed);
+    for (unsigned i=0; i<frames.size(); i++)
+    {
+        QueueFrame(client, frames[i]);
+    }
+}
+
+/*
+ * Drops a client that sent no valid resume request
+ */
+void Communication::RejectClient(boost::shared_ptr<ClientConnection> client)
+{
+    if (!client->is_resumed)
+    {
+        // releases what its catch-up queued, if any
+        CloseClient(client);
+
+        out_mutex_.lock();
+        std::cout << "\n[" << boost::this_thread::get_id()
+                  <<  "] << Subscriber dropped before resuming \n" << std::endl;
+        out_mutex_.unlock();
+        return;
+    }
+
+    // disconnected, or a malformed control request
+    CloseClient(client);
+    if (UnregisterClient(client))
+    {
+        out_mutex_.lock();
+        std::cout << "\n[" << boost::this_thread::get_id()
+                  <<  "] << Subscriber disconnected \n" << std::endl;
+        out_mutex_.unlock();
+        ReportClient(client);
+    }
+}
+
+/*
+ * Adds a client to the registry
+ *  - publishes a new copy of the list, readers keep using their snapshot
+ */
+void Communication::RegisterClient(boost::shared_ptr<ClientConnection> client)
+{
+    boost::mutex::scoped_lock registry_lock(registry_mutex_);
+
+    boost::shared_ptr<ClientList> clients(new ClientList(*clients_));
+    clients->push_back(client);
+    boost::atomic_store(&clients_, boost::shared_ptr<const ClientList>(clients));
+}
+
+/*
+ * Removes a client from the registry
+ *  - returns false if the client was already removed
+ */
+bool Communication::UnregisterClient(boost::shared_ptr<ClientConnection> client)
+{
+    boost::mutex::scoped_lock registry_lock(registry_mutex_);
+
+    boost::shared_ptr<ClientList> clients(new ClientList(*clients_));
+    ClientList::iterator it = std::find(clients->begin(), clients->end(), client);
+    if (it == clients->end())
+    {
+        return false;
+    }
+
+    clients->erase(it);
+    boost::atomic_store(&clients_, boost::shared_ptr<const ClientList>(clients));
+
+    return true;
+}
+
+/*
+ * Queues a frame on a client, sends it if the connection is idle
+ *  - runs in the client's strand
+ *  - applies the slow consumer policy once the client's queue passes the high watermark
+ */
+void Communication::QueueFrame(boost::shared_ptr<ClientConnection> client,
+                               boost::shared_ptr<const std::string> frame)
+{
+    // the client is already disconnected, or paused until it drains
+    if (!client->socket->is_open() || client->is_paused)
+    {
+        if (client->is_paused)
+        {
+            client->dropped_frames.fetch_add(1, boost::memory_order_relaxed);
+        }
+        pending_frames_.fetch_sub(1, boost::memory_order_relaxed);
+        return;
+    }
+
+    // not one of its topics
+    if (!IsSubscribed(client, frame->data() + kFrameHeaderSize, frame->size() - kFrameHeaderSize))
+    {
+        client->filtered_frames.fetch_add(1, boost::memory_order_relaxed);
+        pending_frames_.fetch_sub(1, boost::memory_order_relaxed);
+        return;
+    }
+
+    client->queue.push_back(frame);
+    client->queued_bytes += frame->size();
+
+    if (client->queued_bytes > high_watermark_ && !ApplySlowConsumerPolicy(client))
+    {
+        return;
+    }
+
+    if (client->queued_bytes > client->max_queued_bytes.load(boost::memory_order_relaxed))
+    {
+        client->max_queued_bytes.store(client->queued_bytes, boost::memory_order_relaxed);
+    }
+
+    if (!client->is_writing)
+    {
+        StartWrite(client);
+    }
+}
+
+/*
+ * Writes all queued frames of a client with a single gather write
+ *  - runs in the client's strand
+ */
+void Communication::StartWrite(boost::shared_ptr<ClientConnection> client)
+{
+    // move the queued frames to the write in flight
+    client->in_flight.assign(client->queue.begin(), client->queue.end());
+    client->queue.clear();
+
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(client->in_flight.size());
+    for (unsigned i=0; i<client->in_flight.size(); i++)
+    {
+        buffers.push_back(boost::asio::buffer(*client->in_flight[i]));
+    }
+
+    client->is_writing = true;
+    client->write_started = boost::chrono::steady_clock::now();
+    boost::asio::async_write(*client->socket,
+                             buffers,
+                             client->strand.wrap(boost::bind(&Communication::WriteHandler,
+                                                             this,
+                                                             boost::asio::placeholders::error,
+                                                             boost::asio::placeholders::bytes_transferred,
+                                                             client)));
+}
+
+/*
+ * Handles asyncronous write operations
+ *  - runs in the client's strand
+ *  - counts the delivered frames and bytes, and the write latency
+ *  - goes on with a catch-up, or starts the next write if more frames were queued meanwhile
+ *  - resumes a paused client once it drained to the low watermark
+ *  - removes and reports any disconnected clients
+ */
+void Communication::WriteHandler(const boost::system::error_code& error,
+                             std::size_t bytes_transferred,
+                             boost::shared_ptr<ClientConnection> client)
+{
+    // release the written frames
+    for (unsigned i=0; i<client->in_flight.size(); i++)
+    {
+        client->queued_bytes -= client->in_flight[i]->size();
+    }
+    pending_frames_.fetch_sub(client->in_flight.size(), boost::memory_order_relaxed);
+    std::size_t written = client->in_flight.size();
+    client->in_flight.clear();
+    client->is_writing = false;
+
+    // count successful delivery
+    if (!error)
+    {
+        boost::int64_t latency_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                                        boost::chrono::steady_clock::now() - client->write_started).count();
+        client->write_latency.Record(latency_ns);
+        write_latency_.Record(latency_ns);
+        client->sent_frames.fetch_add(written, boost::memory_order_relaxed);
+        client->sent_bytes.fetch_add(bytes_transferred, boost::memory_order_relaxed);
+        written_frames_.fetch_add(written, boost::memory_order_relaxed);
+        written_bytes_.fetch_add(bytes_transferred, boost::memory_order_relaxed);
+
+        if (client->is_paused && client->queued_bytes <= low_watermark_)
+        {
+            client->is_paused = false;
+        }
+
+        // read the next part of the catch-up, or write the next batch
+        if (client->is_catching_up)
+        {
+            CatchUp(client);
+        }
+        else if (!client->queue.empty())
+        {
+            StartWrite(client);
+        }
+    }
+
+    // remove client
+    else
+    {
+        CloseClient(client);
+
+        // remove disconnected client, report disconnection
+        if (UnregisterClient(client))
+        {
+            out_mutex_.lock();
+            std::cout << "\n[" << boost::this_thread::get_id()
+                      <<  "] << Subscriber disconnected \n" << std::endl;
+            out_mutex_.unlock();
+            ReportClient(client);
+        }
+    }
+}
+
+/*
+ * Closes a client's socket and drops its queued frames
+ *  - runs in the client's strand
+ *  - a write in flight completes with an error and releases its own frames
+ */
+void Communication::CloseClient(boost::shared_ptr<ClientConnection> client)
+{
+    boost::system::error_code ec;
+    client->socket->close(ec);
+
+    for (unsigned i=0; i<client->queue.size(); i++)
+    {
+        client->queued_bytes -= client->queue[i]->size();
+    }
+    pending_frames_.fetch_sub(client->queue.size(), boost::memory_order_relaxed);
+    client->queue.clear();
+}
+
+/*
+ * Deals with a client whose queue passed the high watermark
+ *  - runs in the client's strand
+ *  - returns false if the client was disconnected
+ */
+bool Communication::ApplySlowConsumerPolicy(boost::shared_ptr<ClientConnection> client)
+{
+    out_mutex_.lock();
+    std::cout << "[" << boost::this_thread::get_id()
+              << "] Slow subscriber " << client->name << ": "
+              << client->queued_bytes << " bytes queued" << std::endl;
+    out_mutex_.unlock();
+
+    switch (slow_consumer_policy_)
+    {
+        case kDisconnectSlowConsumer:
+            CloseClient(client);
+            if (UnregisterClient(client))
+            {
+                out_mutex_.lock();
+                std::cout << "\n[" << boost::this_thread::get_id()
+                          <<  "] << Slow subscriber disconnected \n" << std::endl;
+                out_mutex_.unlock();
+                ReportClient(client);
+            }
+            return false;
+
+        case kDropOldest:
+            DropOldest(client, low_watermark_);
+            break;
+
+        case kConflateTopics:
+            ConflateQueue(client);
+            if (client->queued_bytes > high_watermark_)
+            {
+                DropOldest(client, low_watermark_);
+            }
+            break;
+
+        case kPauseSlowConsumer:
+            client->is_paused = true;
+            client->pauses.fetch_add(1, boost::memory_order_relaxed);
+            break;
+    }
+
+    return true;
+}
+
+/*
+ * Keeps only the newest queued frame of each topic
+ *  - runs in the client's strand, the write in flight is left alone
+ */
+void Communication::ConflateQueue(boost::shared_ptr<ClientConnection> client)
+{
+    std::deque< boost::shared_ptr<const std::string> > queue;
+    std::set<std::string> topics;
+
+    for (std::deque< boost::shared_ptr<const std::string> >::reverse_iterator it = client->queue.rbegin();
+         it != client->queue.rend(); ++it)
+    {
+        MessageView view((*it)->data() + kFrameHeaderSize, (*it)->size() - kFrameHeaderSize);
+        if (!view.IsValid() || topics.insert(view.topic().str()).second)
+        {
+            queue.push_front(*it);
+            continue;
+        }
+
+        client->queued_bytes -= (*it)->size();
+        client->conflated_frames.fetch_add(1, boost::memory_order_relaxed);
+        pending_frames_.fetch_sub(1, boost::memory_order_relaxed);
+    }
+
+    client->queue.swap(queue);
+}
+
+/*
+ * Drops a client's oldest queued frames until it is down to @target_bytes
+ *  - runs in the client's strand, the newest frame is always kept
+ */
+void Communication::DropOldest(boost::shared_ptr<ClientConnection> client, std::size_t target_bytes)
+{
+    while (client->queued_bytes > target_bytes && client->queue.size() > 1)
+    {
+        client->queued_bytes -= client->queue.front()->size();
+        client->queue.pop_front();
+        client->dropped_frames.fetch_add(1, boost::memory_order_relaxed);
+        pending_frames_.fetch_sub(1, boost::memory_order_relaxed);
+    }
+}
+
+/*
+ * Checks a message against a client's subscriptions
+ *  - runs in the client's strand
+ *  - a client that never subscribed gets every topic
+ */
+bool Communication::IsSubscribed(boost::shared_ptr<ClientConnection> client, const char* message, std::size_t size)
+{
+    if (!client->is_filtered)
+    {
+        return true;
+    }
+
+    MessageView view(message, size);
+    if (!view.IsValid())
+    {
+        return false;
+    }
+
+    for (unsigned i=0; i<client->subscriptions.size(); i++)
+    {
+        if (TopicMatches(client->subscriptions[i], view.topic()))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Reports a client's connection metrics
+ */
+void Communication::ReportClient(boost::shared_ptr<ClientConnection> client)
+{
+    out_mutex_.lock();
+    std::cout << "[" << boost::this_thread::get_id()
+              << "] Subscriber " << client->name
+              << ": sent = " << client->sent_frames.load(boost::memory_order_relaxed)
+              << ", dropped = " << client->dropped_frames.load(boost::memory_order_relaxed)
+              << ", conflated = " << client->conflated_frames.load(boost::memory_order_relaxed)
+              << ", filtered = " << client->filtered_frames.load(boost::memory_order_relaxed)
+              << ", pauses = " << client->pauses.load(boost::memory_order_relaxed)
+              << ", max queued bytes = " << client->max_queued_bytes.load(boost::memory_order_relaxed) << std::endl;
+    out_mutex_.unlock();
+}
+
+/*
+ * Returns the connection state of a publisher, creating it on first use
+ */
+boost::shared_ptr<ServerConnector> Communication::Connector(const Connection& con)
+{
+    boost::mutex::scoped_lock reconnect_lock(reconnect_mutex_);
+
+    boost::shared_ptr<ServerConnector>& connector = connectors_[con.pub_id];
+    if (!connector)
+    {
+        connector.reset(new ServerConnector(NextIoService(), con));
+    }
+
+    return connector;
+}
+
+/*
+ * Starts a connection attempt to a publisher
+ *  - resolves its address on the first attempt, a failure counts as a failed attempt
+ */
+void Communication::StartConnect(boost::shared_ptr<ServerConnector> connector)
+{
+    if (!connector->is_resolved)
+    {
+        try
+        {
+            boost::asio::ip::tcp::resolver resolver(*io_service_);
+            boost::asio::ip::tcp::resolver::query query(connector->connection.ip, connector->connection.port);
+            connector->endpoint = *resolver.resolve(query);
+            connector->is_resolved = true;
+        }
+
+        // catch any exception
+        catch (std::exception & ex)
+        {
+            out_mutex_.lock();
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] Exception: " << ex.what() << std::endl;
+            out_mutex_.unlock();
+
+            connector->attempts++;
+            ScheduleConnect(connector);
+            return;
+        }
+    }
+
+    connector->connect_attempts.fetch_add(1, boost::memory_order_relaxed);
+    boost::shared_ptr<boost::asio::ip::tcp::socket> sock(new boost::asio::ip::tcp::socket(connector->io_service));
+    sock->async_connect(connector->endpoint,
+                        boost::bind(&Communication::AddServer,
+                                    this,
+                                    boost::asio::placeholders::error(),
+                                    sock,
+                                    connector));
+
+    // report only the first attempt of a series
+    if (connector->attempts == 0)
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Connecting to: " << connector->endpoint << std::endl;
+        out_mutex_.unlock();
+    }
+}
+
+/*
+ * Waits before the next connection attempt to a publisher
+ *  - the delay doubles per failed attempt up to the cap, and is drawn from its
+ *    upper half so that subscribers of a restarted publisher do not come back together
+ *  - gives up after the configured number of failed attempts
+ */
+void Communication::ScheduleConnect(boost::shared_ptr<ServerConnector> connector)
+{
+    if (!Running())
+    {
+        return;
+    }
+
+    if (reconnect_max_attempts_ > 0 && connector->attempts >= reconnect_max_attempts_)
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Giving up on " << connector->connection.pub_id
+                  << " after " << connector->attempts << " attempts" << std::endl;
+        out_mutex_.unlock();
+        return;
+    }
+
+    int delay_ms = reconnect_initial_ms_;
+    for (unsigned i=0; i<connector->attempts && delay_ms < reconnect_max_ms_; i++)
+    {
+        delay_ms *= 2;
+    }
+    delay_ms = std::min(delay_ms, reconnect_max_ms_);
+
+    reconnect_mutex_.lock();
+    boost::random::uniform_int_distribution<int> jitter(delay_ms / 2, delay_ms);
+    delay_ms = jitter(reconnect_random_);
+    reconnect_mutex_.unlock();
+
+    connector->timer.expires_from_now(boost::chrono::milliseconds(delay_ms));
+    connector->timer.async_wait(boost::bind(&Communication::ConnectTimerHandler,
+                                            this,
+                                            boost::asio::placeholders::error(),
+                                            connector));
+}
+
+/*
+ * Retries a connection once its backoff is over
+ */
+void Communication::ConnectTimerHandler(const boost::system::error_code& error,
+                                        boost::shared_ptr<ServerConnector> connector)
+{
+    // cancelled on exit
+    if (error || !Running())
+    {
+        return;
+    }
+
+    StartConnect(connector);
+}
+
+/*
+ * Connects to a server
+ *  - on success: adds all server related elements
+ *  - on failure: schedules a retry
+ */
+void Communication::AddServer(const boost::system::error_code& error,
+                              boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                              boost::shared_ptr<ServerConnector> connector)
+{
+    // remote host is now connected
+    if (!error)
+    {
+        boost::shared_ptr<std::string> server(new std::string(connector->connection.pub_id));
+        connector->attempts = 0;
+        connector->connections.fetch_add(1, boost::memory_order_relaxed);
+        server_connections_.fetch_add(1, boost::memory_order_relaxed);
+
+        // lock any "sockets_.size()" usage/modification
+        com_mutex_.lock();
+
+        // add a pub, along with all related pub elements
+        sockets_.push_back(soc);
+        servers_.push_back(server);
+        boost::shared_ptr< std::vector<char> > new_buf_ptr(new std::vector<char>(kFrameHeaderSize));
+        buf_.push_back(new_buf_ptr);
+        publisher_caches_.push_back(boost::shared_ptr<PublisherCache>(new PublisherCache));
+        publisher_caches_.back()->connection = FindPublisher(*server, true);
+        is_reading_.push_back(false);
+        connections_.push_back(connector->connection);
+
+        // ask for anything missed while away
+        SendResumeRequest(soc, *server);
+
+        // report successful connection
+        out_mutex_.lock();
+        std::cout << "\n[" << boost::this_thread::get_id()
+                  << "] >> Connection to " << *server
+                  << " at " << connector->endpoint << " succeded \n" << std::endl;
+        out_mutex_.unlock();
+
+        // let the read operations begin/continue
+        is_pending_add_ = false;
+        pending_add_condition_.notify_one();
+
+        // unlock any "sockets_.size()" usage/modification
+        com_mutex_.unlock();
+
+        // inform on first connection
+        if (sockets_.size() == 1)
+        {
+            pending_first_condition_->notify_one();
+        }
+    }
+
+    // remote host is not connected (yet), try again later
+    else if (error != boost::asio::error::operation_aborted)
+    {
+        connector->attempts++;
+        ScheduleConnect(connector);
+    }
+}
+
+/*
+ * Sends the resume request on a new server connection
+ *  - @server: the publisher id, for its last sequence number received
+ *  - a publisher not heard from yet is asked for the configured catch-up
+ *  - preceded by the topic subscriptions, so the replay is filtered too
+ */
+void Communication::SendResumeRequest(boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                                      const std::string& server)
+{
+    boost::uint64_t next_sequence = catch_up_sequence_;
+    boost::int64_t since_ns = 0;
+    boost::shared_ptr<std::string> frames(new std::string);
+
+    boost::shared_ptr<PublisherState> publisher = FindPublisher(server, false);
+    if (publisher)
+    {
+        boost::mutex::scoped_lock publisher_lock(publisher->mutex);
+        if (publisher->last_sequence > 0)
+        {
+            next_sequence = publisher->last_sequence + 1;
+        }
+
+        if (publisher->is_filtered)
+        {
+            // an empty filter still has to be set
+            frames->append(EncodeFrame(EncodeSubscription(kUnsubscribeControl, "")));
+            for (unsigned i=0; i<publisher->topics.size(); i++)
+            {
+                frames->append(EncodeFrame(EncodeSubscription(kSubscribeControl, publisher->topics[i])));
+            }
+        }
+    }
+
+    if (next_sequence == 0 && catch_up_seconds_ > 0)
+    {
+        since_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                       boost::chrono::system_clock::now().time_since_epoch()).count() -
+                   static_cast<boost::int64_t>(catch_up_seconds_) * 1000000000LL;
+    }
+
+    frames->append(EncodeFrame(EncodeResumeRequest(next_sequence, since_ns)));
+    SendControl(soc, frames);
+}
+
+/*
+ * Writes control request frames to a server
+ */
+void Communication::SendControl(boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                                boost::shared_ptr<std::string> frames)
+{
+    boost::asio::async_write(*soc,
+                             boost::asio::buffer(*frames),
+                             boost::bind(&Communication::ControlRequestHandler,
+                                         this,
+                                         boost::asio::placeholders::error,
+                                         frames));
+}
+
+/*
+ * Handles a control request write
+ *  - a failure also fails the reads, which handle the disconnection
+ *  - @frames: only bound to keep the requests alive during the write
+ */
+void Communication::ControlRequestHandler(const boost::system::error_code& error,
+                                          boost::shared_ptr<std::string> /* frames */)
+{
+    if (error && error != boost::asio::error::operation_aborted)
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Error: " << error.message() << std::endl;
+        out_mutex_.unlock();
+    }
+}
+
+/*
+ * Records a subscription change and sends it to the server, if connected
+ *  - kept for reconnections, and applied to multicast and shared ring messages here
+ */
+void Communication::UpdateSubscription(const std::string& server, const std::string& pattern, ControlType type)
+{
+    boost::shared_ptr<PublisherState> publisher = FindPublisher(server, true);
+    publisher->mutex.lock();
+    std::vector<std::string>& topics = publisher->topics;
+    std::vector<std::string>::iterator it = std::find(topics.begin(), topics.end(), pattern);
+    if (type == kSubscribeControl && it == topics.end())
+    {
+        topics.push_back(pattern);
+    }
+    else if (type == kUnsubscribeControl && it != topics.end())
+    {
+        topics.erase(it);
+    }
+    publisher->is_filtered = true;
+    publisher->mutex.unlock();
+
+    boost::mutex::scoped_lock iter_lock(com_mutex_);
+    for (unsigned i=0; i<servers_.size(); i++)
+    {
+        if (*servers_[i] == server)
+        {
+            SendControl(sockets_[i], boost::shared_ptr<std::string>(new std::string(EncodeFrame(EncodeSubscription(type, pattern)))));
+        }
+    }
+}
+
+/*
+ * Asks a server for messages lost on its multicast group or shared ring
+ *  - sent over its TCP connection, if connected (the replay then comes that way)
+ */
+void Communication::RequestReplay(const std::string& server, boost::uint64_t first_sequence, boost::uint64_t last_sequence)
+{
+    boost::mutex::scoped_lock iter_lock(com_mutex_);
+    for (unsigned i=0; i<servers_.size(); i++)
+    {
+        if (*servers_[i] == server)
+        {
+            SendControl(sockets_[i], boost::shared_ptr<std::string>(new std::string(EncodeFrame(EncodeReplayRequest(first_sequence, last_sequence)))));
+        }
+    }
+}
+
+/*
+ * Handles the frame header of asyncronous read operations
+ *  - reads the frame payload on a valid header
+ *  - removes the server on a disconnection or a malformed/oversized frame
+ */
+void Communication::ReadHeaderHandler(const boost::system::error_code& error,
+                                      std::size_t bytes_transferred,
+                                      boost::shared_ptr< std::vector<char> > buffer,
+                                      boost::shared_ptr<std::string> server_name,
+                                      boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                                      boost::shared_ptr<PublisherCache> publishers)
+{
+    std::size_t payload_size = 0;
+
+    // valid header
+    if (!error && bytes_transferred == kFrameHeaderSize &&
+        DecodeFrameHeader(&(*buffer)[0], max_message_size_, payload_size))
+    {
+        // async_read the payload on this server
+        buffer->resize(payload_size);
+        boost::asio::async_read(*soc,
+                                boost::asio::buffer(*buffer),
+                                boost::bind(&Communication::ReadPayloadHandler,
+                                            this,
+                                            boost::asio::placeholders::error,
+                                            boost::asio::placeholders::bytes_transferred,
+                                            buffer,
+                                            server_name,
+                                            soc,
+                                            publishers));
+    }
+
+    else  // server is disconnected (or misbehaving) and will be removed
+    {
+        if (!error)
+        {
+            out_mutex_.lock();
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] Error: invalid frame from " << *server_name << std::endl;
+            out_mutex_.unlock();
+        }
+
+        com_mutex_.lock();
+        RemoveServer(server_name, soc);
+        com_mutex_.unlock();
+    }
+}
+
+/*
+ * Handles the frame payload of asyncronous read operations
+ *  - queues the message from server(s), never waits for its processing
+ *  - removes any disconnected servers
+ */
+void Communication::ReadPayloadHandler(const boost::system::error_code& error,
+                                       std::size_t /* bytes_transferred */,
+                                       boost::shared_ptr< std::vector<char> > buffer,
+                                       boost::shared_ptr<std::string> server_name,
+                                       boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                                       boost::shared_ptr<PublisherCache> publishers)
+{
+    // successful read
+    if (!error)
+    {
+        PushMessage(*buffer, *publishers);
+
+        // async_read next frame header on this server
+        buffer->resize(kFrameHeaderSize);
+        boost::asio::async_read(*soc,
+                                boost::asio::buffer(*buffer),
+                                boost::bind(&Communication::ReadHeaderHandler,
+                                            this,
+                                            boost::asio::placeholders::error,
+                                            boost::asio::placeholders::bytes_transferred,
+                                            buffer,
+                                            server_name,
+                                            soc,
+                                            publishers));
+    }
+
+    else  // server is disconnected and will be removed
+    {
+        com_mutex_.lock();
+        RemoveServer(server_name, soc);
+        com_mutex_.unlock();
+    }
+}
+
+/*
+ * Removes a disconnected server and tries to reconnect to it
+ *  - com_mutex_ must be held by the caller
+ */
+void Communication::RemoveServer(boost::shared_ptr<std::string> server_name,
+                                 boost::shared_ptr<boost::asio::ip::tcp::socket> soc)
+{
+    out_mutex_.lock();
+    std::cout << "\n[" << boost::this_thread::get_id()
+              << "] << " << *server_name << " is now disconnected \n" << std::endl;
+    out_mutex_.unlock();
+
+
+    // close this socket
+    boost::system::error_code ec;
+    soc->close(ec);
+
+    for (unsigned i=0; i<sockets_.size(); i++)
+    {
+        // find the closed socket
+        if (!sockets_[i]->is_open())
+        {
+            // try to reconnect to this server, after a backoff
+            ScheduleConnect(Connector(connections_[i]));
+
+            // erase all server related elements
+            sockets_.erase(sockets_.begin()+i);
+            servers_.erase(servers_.begin()+i);
+            buf_.erase(buf_.begin()+i);
+            publisher_caches_.erase(publisher_caches_.begin()+i);
+            is_reading_.erase(is_reading_.begin()+i);
+            connections_.erase(connections_.begin()+i);
+
+            break;
+        }
+    }
+
+    // check if all servers are disconnected
+    if (sockets_.size() == 0)
+    {
+        // report for waiting on <RETURN> keystroke
+        NoServerReport();
+    }
+}
+
+/*
+ * Subscribes to a server's topics matching a pattern
+ *  - @server: the publisher id
+ *  - @pattern: a topic, "*" stands for one level and "#" for any number of levels
+ *  - a publisher without subscriptions sends all its topics
+ */
+void Communication::Subscribe(const std::string& server, const std::string& pattern)
+{
+    UpdateSubscription(server, pattern, kSubscribeControl);
+}
+
+/*
+ * Removes a subscription made with Subscribe
+ *  - the publisher stays filtered, without subscriptions it sends nothing
+ */
+void Communication::Unsubscribe(const std::string& server, const std::string& pattern)
+{
+    UpdateSubscription(server, pattern, kUnsubscribeControl);
+}
+
+/*
+ * Queues a read message for the processing threads
+ *  - takes the payload's bytes over without copying, @payload is left empty
+ *  - @publishers: the publishers already seen on the connection the message came from
+ *  - records the publish to receive latency, messages dropped next included
+ *  - drops the message if the queue is full, so io threads never block
+ */
+void Communication::PushMessage(std::vector<char>& payload, PublisherCache& publishers)
+{
+    boost::shared_ptr<PublisherLatency> latency;
+    if (!TrackSequence(payload, publishers, latency))
+    {
+        return;
+    }
+
+    ReceivedMessage* message = new ReceivedMessage;
+    message->bytes.swap(payload);
+    message->received = boost::chrono::steady_clock::now();
+    message->latency = latency;
+
+    // the send timestamp is on this host's steady clock, version 1 messages have none
+    MessageView view(message->bytes.empty() ? 0 : &message->bytes[0], message->bytes.size());
+    if (latency && view.send_timestamp_ns() != 0)
+    {
+        latency->publish_to_receive.Record(boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                                               message->received.time_since_epoch()).count() - view.send_timestamp_ns());
+    }
+
+    if (!messages_->bounded_push(message))
+    {
+        delete message;
+        dropped_messages_.fetch_add(1, boost::memory_order_relaxed);
+        return;
+    }
+
+    // keep the queue depth metrics
+    long depth = queue_depth_.fetch_add(1, boost::memory_order_relaxed) + 1;
+    long max_depth = max_queue_depth_.load(boost::memory_order_relaxed);
+    while (depth > max_depth &&
+           !max_queue_depth_.compare_exchange_weak(max_depth, depth, boost::memory_order_relaxed)) {}
+
+    // wake a waiting processing thread (the lock orders this with its last check of the queue)
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (waiting_processors_.load(boost::memory_order_relaxed) > 0)
+    {
+        boost::mutex::scoped_lock queue_lock(message_queue_mutex_);
+        setting_message_condition_->notify_one();
+    }
+}
+
+/*
+ * Reads a shared-memory ring until exit
+ *  - waits for the publisher to create the ring, then reads from its current head
+ *  - messages overwritten before being read leave a sequence gap, counted as missing
+ *    and asked for again like a multicast one
+ *  - re-opens the ring once the publisher recreated it (checked while idle, once a
+ *    second and on every TCP connection), then reads it from its oldest message
+ */
+void Communication::ReadSharedRing(boost::shared_ptr<PublisherState> connection, std::string name)
+{
+    boost::shared_ptr<SharedRing> ring;
+    boost::uint64_t cursor = 0;
+    boost::uint64_t skipped = 0;
+    std::vector<char> message;
+    PublisherCache publishers;
+    publishers.connection = connection;
+    publishers.is_recoverable = true;
+    bool is_recreated = false;
+    unsigned long checked_connections = 0;
+    boost::chrono::steady_clock::time_point checked;
+
+    while (Running())
+    {
+        // not created (again) yet, try again
+        if (!ring)
+        {
+            try
+            {
+                ring.reset(new SharedRing(name));
+            }
+            catch (std::exception &)
+            {
+                usleep(100000);
+                continue;
+            }
+
+            // a recreated ring holds the restarted publisher's first messages
+            boost::uint64_t head = ring->head();
+            cursor = !is_recreated ? head + 1 : (head >= ring->slot_count() ? head - ring->slot_count() + 1 : 1);
+            checked_connections = server_connections_.load(boost::memory_order_relaxed);
+            checked = boost::chrono::steady_clock::now();
+
+            out_mutex_.lock();
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] >> " << (is_recreated ? "Re-opened" : "Reading") << " shared ring: " << name << std::endl;
+            out_mutex_.unlock();
+        }
+
+        if (ring->TryRead(cursor, message, skipped))
+        {
+            PushMessage(message, publishers);
+            continue;
+        }
+        if (ring->head() >= cursor)
+        {
+            continue;
+        }
+
+        // idle: make sure the publisher did not recreate the ring meanwhile
+        unsigned long connections = server_connections_.load(boost::memory_order_relaxed);
+        boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        if (connections != checked_connections || now - checked >= boost::chrono::seconds(1))
+        {
+            checked_connections = connections;
+            checked = now;
+            if (!ring->IsCurrent())
+            {
+                ring.reset();
+                is_recreated = true;
+                continue;
+            }
+        }
+
+        ring->Wait(cursor, 100);
+    }
+}
+
+/*
+ * Receives the next datagram of a multicast group
+ */
+void Communication::StartReceive(boost::shared_ptr<MulticastReceiver> receiver)
+{
+    receiver->socket.async_receive_from(boost::asio::buffer(receiver->datagram),
+                                        receiver->sender,
+                                        boost::bind(&Communication::ReceiveHandler,
+                                                    this,
+                                                    boost::asio::placeholders::error,
+                                                    boost::asio::placeholders::bytes_transferred,
+                                                    receiver));
+}
+
+/*
+ * Handles asyncronous multicast receive operations
+ *  - queues the frame payload, drops invalid datagrams
+ */
+void Communication::ReceiveHandler(const boost::system::error_code& error,
+                                   std::size_t bytes_transferred,
+                                   boost::shared_ptr<MulticastReceiver> receiver)
+{
+    // the group was left on exit
+    if (error == boost::asio::error::operation_aborted || !receiver->socket.is_open())
+    {
+        return;
+    }
+
+    std::size_t payload_size = 0;
+
+    if (error)
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Error: " << error.message() << std::endl;
+        out_mutex_.unlock();
+    }
+
+    // a datagram carries exactly one frame
+    else if (bytes_transferred >= kFrameHeaderSize &&
+             DecodeFrameHeader(&receiver->datagram[0], max_message_size_, payload_size) &&
+             payload_size == bytes_transferred - kFrameHeaderSize)
+    {
+        std::vector<char> payload(receiver->datagram.begin() + kFrameHeaderSize,
+                                  receiver->datagram.begin() + bytes_transferred);
+        PushMessage(payload, receiver->publishers);
+    }
+
+    else
+    {
+        out_mutex_.lock();
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Error: invalid datagram from " << receiver->sender << std::endl;
+        out_mutex_.unlock();
+    }
+
+    StartReceive(receiver);
+}
+
+/*
+ * Returns the state of a publisher
+ *  - @is_created: creates it if missing (false: returns NULL)
+ */
+boost::shared_ptr<PublisherState> Communication::FindPublisher(const std::string& id, bool is_created)
+{
+    boost::mutex::scoped_lock publishers_lock(publishers_mutex_);
+
+    std::map<std::string, boost::shared_ptr<PublisherState> >::iterator it = publishers_.find(id);
+    if (it != publishers_.end())
+    {
+        return it->second;
+    }
+    if (!is_created)
+    {
+        return boost::shared_ptr<PublisherState>();
+    }
+
+    boost::shared_ptr<PublisherState> publisher(new PublisherState(id));
+    publishers_[id] = publisher;
+    return publisher;
+}
+
+/*
+ * Returns the state of a message's publisher
+ *  - @publishers: the connection's publishers, searched first (a connection rarely
+ *    carries more than a few, e.g. through a broker), the registry is only locked once
+ *    per new publisher and connection
+ */
+PublisherState& Communication::ResolvePublisher(StringRef id, PublisherCache& publishers)
+{
+    std::vector< boost::shared_ptr<PublisherState> >& seen = publishers.publishers;
+    for (unsigned i=0; i<seen.size(); i++)
+    {
+        const std::string& known = seen[i]->id;
+        if (known.size() == id.size && known.compare(0, known.size(), id.data, id.size) == 0)
+        {
+            return *seen[i];
+        }
+    }
+
+    seen.push_back(FindPublisher(id.str(), true));
+    return *seen.back();
+}
+
+/*
+ * Checks a message's sequence number against the last one of its publisher
+ *  - counts the messages skipped in between as missing
+ *  - returns false for a message already received (e.g. over both TCP and multicast)
+ *  - returns false for a topic not subscribed to on the message's connection; over TCP
+ *    its gaps are then not counted (a filtered stream skips sequence numbers)
+ *  - a multicast group or shared ring carries every message: its gaps are asked for
+ *    again over the publisher's TCP connection (a filtered one's still not counted,
+ *    they also hold other topics), and a replayed message is accepted
+ *  - sequence 1 starts a new stream (publisher restarted)
+ *  - @publishers: the message's connection and the publishers already seen on it
+ *  - @latency: set to the publisher's latency histograms, for a valid message
+ *  - only locks the connection's and the publisher's own state, never both at once
+ */
+bool Communication::TrackSequence(const std::vector<char>& payload, PublisherCache& publishers,
+                                  boost::shared_ptr<PublisherLatency>& latency)
+{
+    MessageView view(payload.empty() ? 0 : &payload[0], payload.size());
+
+    // leave malformed messages to the processing threads
+    if (!view.IsValid())
+    {
+        return true;
+    }
+
+    boost::uint64_t sequence = view.sequence();
+    PublisherState& publisher = ResolvePublisher(view.publisher_id(), publishers);
+    publisher.messages.fetch_add(1, boost::memory_order_relaxed);
+    publisher.bytes.fetch_add(payload.size(), boost::memory_order_relaxed);
+
+    // the connection's filter: its group/ring messages are filtered here
+    bool is_filtered = false;
+    bool is_matched = true;
+    if (publishers.connection)
+    {
+        PublisherState& connection = *publishers.connection;
+        boost::mutex::scoped_lock connection_lock(connection.mutex);
+
+        is_filtered = connection.is_filtered;
+        is_matched = !is_filtered;
+        for (unsigned i=0; !is_matched && i<connection.topics.size(); i++)
+        {
+            is_matched = TopicMatches(connection.topics[i], view.topic());
+        }
+        if (!is_matched && !publishers.is_recoverable)
+        {
+            return false;
+        }
+    }
+
+    boost::mutex::scoped_lock publisher_lock(publisher.mutex);
+    latency = publisher.latency;
+
+    if (publisher.last_sequence == 0 || sequence == 1)
+    {
+        publisher.last_sequence = sequence;
+        publisher.gaps.clear();
+        return is_matched;
+    }
+
+    if (sequence <= publisher.last_sequence)
+    {
+        // one of the messages asked for again
+        if (RemoveGap(publisher.gaps, sequence))
+        {
+            recovered_messages_.fetch_add(1, boost::memory_order_relaxed);
+            return is_matched;
+        }
+        // (an unmatched one may just have been skipped by the filtered TCP stream)
+        if (is_matched)
+        {
+            duplicate_messages_.fetch_add(1, boost::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    boost::uint64_t first_missing = publisher.last_sequence + 1;
+    publisher.last_sequence = sequence;
+    if (sequence > first_missing && !is_filtered)
+    {
+        missing_messages_.fetch_add(sequence - first_missing, boost::memory_order_relaxed);
+    }
+
+    // only the connection's own publisher can replay them (not a broker's publishers)
+    if (sequence > first_missing && publishers.is_recoverable && &publisher == publishers.connection.get())
+    {
+        publisher.gaps.push_back(std::make_pair(first_missing, sequence - 1));
+        if (publisher.gaps.size() > kMaxReplayGaps)
+        {
+            publisher.gaps.pop_front();
+        }
+        publisher_lock.unlock();
+        RequestReplay(publisher.id, first_missing, sequence - 1);
+    }
+
+    return is_matched;
+}
+
+/*
+ * Removes a sequence number from the ranges asked for again
+ *  - returns false if it is in none of them
+ *  - the ranges are in order (appended as found), so they are binary searched
+ *  - the caller holds the publisher's mutex
+ */
+bool Communication::RemoveGap(std::deque< std::pair<boost::uint64_t, boost::uint64_t> >& gaps, boost::uint64_t sequence)
+{
+    // first range not ending before the sequence
+    std::size_t low = 0;
+    std::size_t high = gaps.size();
+    while (low < high)
+    {
+        std::size_t middle = low + (high - low) / 2;
+        if (gaps[middle].second < sequence)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    std::size_t i = low;
+    if (i < gaps.size() && sequence >= gaps[i].first)
+    {
+        std::pair<boost::uint64_t, boost::uint64_t>& gap = gaps[i];
+        if (gap.first == gap.second)
+        {
+            gaps.erase(gaps.begin() + i);
+        }
+        else if (sequence == gap.first)
+        {
+            gap.first++;
+        }
+        else if (sequence == gap.second)
+        {
+            gap.second--;
+        }
+        else
+        {
+            // split the range
+            std::pair<boost::uint64_t, boost::uint64_t> rest(sequence + 1, gap.second);
+            gap.second = sequence - 1;
+            gaps.insert(gaps.begin() + i + 1, rest);
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Reports the percentiles of one latency histogram, in microseconds
+ *  - the caller holds out_mutex_
+ */
+void Communication::ReportPercentiles(const std::string& server, const char* stage, const HdrHistogram& histogram)
+{
+    std::ostringstream line;
+    line << std::fixed;
+    line.precision(1);
+
+    line << "Latency from " << server << " (" << stage << "): count = " << histogram.count();
+    if (histogram.count() > 0)
+    {
+        line << ", p50 = " << histogram.Percentile(50) / 1e3
+             << " us, p90 = " << histogram.Percentile(90) / 1e3
+             << " us, p99 = " << histogram.Percentile(99) / 1e3
+             << " us, p99.9 = " << histogram.Percentile(99.9) / 1e3
+             << " us, max = " << histogram.max_ns() / 1e3 << " us";
+    }
+
+    std::cout << "[" << boost::this_thread::get_id()
+              << "] " << line.str() << std::endl;
+}
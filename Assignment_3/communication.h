@@ -3,8 +3,206 @@
 #include <boost/thread.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/chrono.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <algorithm>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <set>
+#include <pthread.h>
+#include "framing.h"
+#include "message.h"
+#include "shared_ring.h"
+#include "journal.h"
+#include "metrics.h"
 #include "options.h"
 
+const std::size_t kDefaultMessageQueueCapacity = 1024;  // read messages waiting for processing
+
+const std::size_t kDefaultHighWatermarkBytes = 8 << 20;  // queued bytes that make a subscriber slow
+const std::size_t kDefaultLowWatermarkBytes = 2 << 20;   // queued bytes it is trimmed or drained to
+
+/*
+ * Publisher-side connection to a subscriber
+ *  - queues shared, already encoded frames
+ *  - keeps at most one write in flight, the next write gathers everything queued meanwhile
+ *  - all its members are only touched through its strand, except the metrics
+ */
+struct ClientConnection
+{
+    ClientConnection(boost::asio::io_service& io_service) : socket(new boost::asio::ip::tcp::socket(io_service)),
+                                                            strand(io_service),
+                                                            is_resumed(false),
+                                                            is_catching_up(false),
+                                                            resume_sequence(0),
+                                                            caught_up_sequence(0),
+                                                            replayed(0),
+                                                            is_filtered(false),
+                                                            is_writing(false),
+                                                            is_paused(false),
+                                                            queued_bytes(0),
+                                                            max_queued_bytes(0),
+                                                            sent_frames(0),
+                                                            dropped_frames(0),
+                                                            conflated_frames(0),
+                                                            filtered_frames(0),
+                                                            pauses(0),
+                                                            sent_bytes(0) {}
+
+    boost::shared_ptr<boost::asio::ip::tcp::socket> socket;
+    boost::asio::io_service::strand strand;                        // serialises this connection's handlers
+    std::deque< boost::shared_ptr<const std::string> > queue;      // frames waiting for the next write
+    std::vector< boost::shared_ptr<const std::string> > in_flight; // frames of the current write
+    std::vector<char> request;                                     // control request being read
+    std::string name;                                              // remote endpoint, for reports
+    bool is_resumed;                                               // flag for a client in the fan-out
+    bool is_catching_up;                                           // replaying, not in the fan-out yet
+    boost::uint64_t resume_sequence,                               // sequence it resumed from (0: live only)
+                    caught_up_sequence;                            // last sequence read for its catch-up
+    std::size_t replayed;                                          // frames queued by its catch-up
+    bool is_filtered;                                              // flag for a client that sent subscriptions
+    std::vector<std::string> subscriptions;                        // topic patterns it subscribed to
+    bool is_writing;                                               // flag for a write in flight
+    bool is_paused;                                                // skipping new frames (pause policy)
+    boost::chrono::steady_clock::time_point write_started;         // start of the write in flight
+
+    // metrics, read from any thread
+    boost::atomic<std::size_t> queued_bytes,                       // bytes queued and in flight
+                               max_queued_bytes;
+    boost::atomic<unsigned long> sent_frames,
+                                 dropped_frames,
+                                 conflated_frames,
+                                 filtered_frames,
+                                 pauses;
+    boost::atomic<boost::uint64_t> sent_bytes;
+    LatencyHistogram write_latency;                                // per gather write
+};
+
+typedef std::deque< std::pair< boost::uint64_t, boost::shared_ptr<const std::string> > > ReplayRing;
+
+const std::size_t kDefaultReplayBufferSize = 1024;  // recent frames kept for reconnecting subs
+const std::size_t kCatchUpBatchSize = 1024;         // journal messages read per catch-up batch
+const std::size_t kCatchUpStepSize = 4096;          // journal messages read per catch-up handler (queued or not)
+const std::size_t kMaxReplayGaps = 4096;            // sequence ranges a sub awaits per publisher (oldest given up)
+
+typedef std::vector< boost::shared_ptr<ClientConnection> > ClientList;
+
+const std::size_t kMaxDatagramSize = 65507;  // largest UDP payload
+
+const int kDefaultReconnectInitialMs = 100;    // first reconnect delay
+const int kDefaultReconnectMaxMs = 10000;      // reconnect delay cap
+
+/*
+ * Subscriber-side connection state of one publisher
+ *  - at most one connect or backoff wait is pending at a time
+ *  - attempts count the failures since the last successful connection
+ */
+struct ServerConnector
+{
+    ServerConnector(boost::asio::io_service& io_service,
+                    const Connection& con) : io_service(io_service),
+                                             connection(con),
+                                             timer(io_service),
+                                             is_resolved(false),
+                                             attempts(0),
+                                             connect_attempts(0),
+                                             connections(0) {}
+
+    boost::asio::io_service& io_service;           // runs the connects and the timer
+    Connection connection;
+    boost::asio::ip::tcp::endpoint endpoint;       // resolved on the first attempt
+    boost::asio::basic_waitable_timer<boost::chrono::steady_clock> timer;  // backoff before the next attempt
+    bool is_resolved;
+    unsigned attempts;
+
+    // metrics, read from any thread
+    boost::atomic<unsigned long> connect_attempts,
+                                 connections;
+};
+
+/*
+ * End-to-end latency of one publisher's messages
+ *  - publish to receive: from the send timestamp to the push onto the message queue
+ *  - receive to process: from that push to the end of the message's processing
+ */
+struct PublisherLatency : boost::noncopyable
+{
+    HdrHistogram publish_to_receive,
+                 receive_to_process;
+};
+
+/*
+ * Subscriber-side state of one publisher, over any transport
+ *  - created once per publisher, then resolved once per connection (PublisherCache)
+ *  - its mutex only serialises the transports delivering this publisher (e.g. TCP and multicast)
+ *  - the topic filter is kept on the configured connection's id, which is not the
+ *    publisher id of the messages on a broker connection
+ */
+struct PublisherState : boost::noncopyable
+{
+    PublisherState(const std::string& publisher_id) : id(publisher_id),
+                                                      last_sequence(0),
+                                                      is_filtered(false),
+                                                      latency(new PublisherLatency),
+                                                      messages(0),
+                                                      bytes(0) {}
+
+    const std::string id;
+    boost::mutex mutex;                          // mutex for last_sequence, gaps, is_filtered and topics
+    boost::uint64_t last_sequence;               // last sequence number received, 0: none yet
+    std::deque< std::pair<boost::uint64_t, boost::uint64_t> > gaps; // sequence ranges asked for again, not received yet
+    bool is_filtered;                            // flag for a connection subscribed to by topic
+    std::vector<std::string> topics;             // topic patterns subscribed to on the connection
+    boost::shared_ptr<PublisherLatency> latency;
+
+    // metrics, read from any thread
+    boost::atomic<unsigned long> messages;
+    boost::atomic<boost::uint64_t> bytes;
+};
+
+/*
+ * The publishers seen on one connection (TCP, multicast group or shared ring)
+ */
+struct PublisherCache
+{
+    PublisherCache() : is_recoverable(false) {}
+
+    boost::shared_ptr<PublisherState> connection;                // the configured publisher (or broker), its topic filter
+    std::vector< boost::shared_ptr<PublisherState> > publishers; // the publishers of its messages (several through a broker)
+    bool is_recoverable;                                         // flag for a multicast group or shared ring: carries every
+                                                                 // message, its gaps are asked for again over TCP
+};
+
+/*
+ * A read message, as queued for the processing threads
+ */
+struct ReceivedMessage
+{
+    std::vector<char> bytes;                                  // the encoded message
+    boost::chrono::steady_clock::time_point received;         // when it was queued
+    boost::shared_ptr<PublisherLatency> latency;              // its publisher's, unset for malformed messages
+};
+
+/*
+ * Subscriber-side multicast group membership
+ *  - a single receive is outstanding at a time, so its members need no lock
+ */
+struct MulticastReceiver
+{
+    MulticastReceiver(boost::asio::io_service& io_service) : socket(io_service),
+                                                             datagram(kMaxDatagramSize) {}
+
+    boost::asio::ip::udp::socket socket;
+    boost::asio::ip::udp::endpoint sender;
+    std::vector<char> datagram;                                    // receive buffer, one frame per datagram
+    PublisherCache publishers;                                     // publishers seen in the group
+};
+
 /*
  * Network wrapper class for client/server operations
  */
@@ -12,94 +210,250 @@ class Communication
 {
     public:
         // constructor initialisations
-        Communication() : is_pending_add_(true),
-                          is_picked_message_(true),
-                          is_set_message_(false),
+        Communication() : next_io_service_(0),
+                          max_message_size_(kDefaultMaxMessageSize),
+                          clients_(new ClientList),
+                          is_tcp_fanout_(true),
+                          pending_frames_(0),
+                          written_messages_(0),
+                          written_frames_(0),
+                          written_bytes_(0),
+                          high_watermark_(kDefaultHighWatermarkBytes),
+                          low_watermark_(kDefaultLowWatermarkBytes),
+                          slow_consumer_policy_(kDisconnectSlowConsumer),
+                          replay_capacity_(kDefaultReplayBufferSize),
+                          is_pending_add_(true),
+                          queue_depth_(0),
+                          max_queue_depth_(0),
+                          waiting_processors_(0),
+                          server_connections_(0),
+                          dropped_messages_(0),
+                          missing_messages_(0),
+                          duplicate_messages_(0),
+                          recovered_messages_(0),
+                          catch_up_sequence_(0),
+                          catch_up_seconds_(0),
+                          reconnect_initial_ms_(kDefaultReconnectInitialMs),
+                          reconnect_max_ms_(kDefaultReconnectMaxMs),
+                          reconnect_max_attempts_(0),
+                          reconnect_random_(static_cast<boost::uint32_t>(std::time(0)) ^ getpid()),
                           pending_first_condition_(new boost::condition_variable),
-                          setting_message_condition_(new boost::condition_variable),
-                          getting_message_condition_(new boost::condition_variable) {}
+                          setting_message_condition_(new boost::condition_variable) {}
 
         // accessors
         boost::shared_ptr<boost::asio::io_service> io_service() {return io_service_;}
         boost::shared_ptr<boost::condition_variable> pending_first_condition() {return pending_first_condition_;}
-        boost::shared_ptr<boost::condition_variable> setting_message_condition() {return setting_message_condition_;}
-        boost::shared_ptr<boost::condition_variable> getting_message_condition() {return getting_message_condition_;}
-        bool is_set_message() {return is_set_message_;}
-        std::string message() {return message_;}
+        long pending_frames() {return pending_frames_.load(boost::memory_order_relaxed);}
+        unsigned long written_messages() {return written_messages_.load(boost::memory_order_relaxed);}
+        std::size_t client_count() {return boost::atomic_load(&clients_)->size();}
+        long queue_depth() {return queue_depth_.load(boost::memory_order_relaxed);}
+        long max_queue_depth() {return max_queue_depth_.load(boost::memory_order_relaxed);}
+        unsigned long dropped_messages() {return dropped_messages_.load(boost::memory_order_relaxed);}
+        unsigned long missing_messages() {return missing_messages_.load(boost::memory_order_relaxed);}
+        unsigned long duplicate_messages() {return duplicate_messages_.load(boost::memory_order_relaxed);}
+        unsigned long recovered_messages() {return recovered_messages_.load(boost::memory_order_relaxed);}
 
         // mutators
-        void set_is_picked_message(bool is_read) {is_picked_message_ = is_read;}
-        void set_is_set_message(bool is_set) {is_set_message_ = is_set;}
+        void set_id(std::string id) {id_ = id;}
+        void set_max_message_size(std::size_t size) {max_message_size_ = size;}
+        void set_replay_capacity(std::size_t capacity) {replay_capacity_ = capacity;}
+        void set_slow_consumer(std::size_t high_bytes, std::size_t low_bytes, SlowConsumerPolicy policy)
+        {
+            high_watermark_ = high_bytes;
+            low_watermark_ = std::min(low_bytes, high_bytes);
+            slow_consumer_policy_ = policy;
+        }
+        void set_catch_up(boost::uint64_t sequence, int seconds) {catch_up_sequence_ = sequence; catch_up_seconds_ = seconds;}
+        void set_reconnect(int initial_ms, int max_ms, unsigned max_attempts)
+        {
+            reconnect_initial_ms_ = initial_ms;
+            reconnect_max_ms_ = max_ms;
+            reconnect_max_attempts_ = max_attempts;
+        }
 
         // common funtionality for pubs/subs
         void InitIoService();
+        void InitIoServicePool(int pool_size);
         void LaunchThreads(int thread_count);
         void PrepareForExit(std::string role);
+        void EnableMetrics(std::string id, std::string port, std::string json_file, int json_interval_ms,
+                           MetricsExporter::Collector collect = MetricsExporter::Collector());
+        void CollectMetrics(MetricsSnapshot& snapshot);
         bool Running() {return !io_service_->stopped();}
         bool NoConnections() {return sockets_.size() == 0;}
 
         // pub only
         void Accept(std::string port);
-        void Write(std::string str, int length);
+        void EnableMulticast(std::string group, std::string port, std::string interface, bool tcp_fanout);
+        void EnableSharedRing(std::string name, boost::uint32_t slots, boost::uint32_t slot_size, bool tcp_fanout);
+        boost::uint64_t EnableJournal(std::string directory, std::size_t segment_size,
+                                      std::size_t sync_every, int sync_interval_ms);
+        void Write(const std::string& message);
 
         // sub only
         void Connect(int servers_count, std::vector<Connection> servers);
         void Read();
+        void JoinMulticast(std::string server, std::string group, std::string port, std::string interface);
+        void JoinSharedRing(std::string server, std::string name);
+        void Subscribe(const std::string& server, const std::string& pattern);
+        void Unsubscribe(const std::string& server, const std::string& pattern);
+        void InitMessageQueue(std::size_t capacity);
+        bool PopMessage(ReceivedMessage& message);
+        bool WaitMessage(ReceivedMessage& message);
+        void MessageProcessed(const ReceivedMessage& message);
+        void ReportLatency();
+        std::map<std::string, boost::shared_ptr<PublisherLatency> > latencies();
         void NoServerReport();
 
 
     private:
         // common funtionality for pubs/subs
         void Run();
+        void RunPooled(unsigned index);
+        boost::asio::io_service& NextIoService();
 
         // pub only
         void AddClient(const boost::system::error_code& error,
-                       boost::shared_ptr<boost::asio::ip::tcp::socket> sock);
+                       boost::shared_ptr<ClientConnection> client);
+        void ReadControl(boost::shared_ptr<ClientConnection> client);
+        void ControlHeaderHandler(const boost::system::error_code& error,
+                                  std::size_t bytes_transferred,
+                                  boost::shared_ptr<ClientConnection> client);
+        void ControlHandler(const boost::system::error_code& error,
+                            std::size_t bytes_transferred,
+                            boost::shared_ptr<ClientConnection> client);
+        void Resume(boost::shared_ptr<ClientConnection> client);
+        void CatchUp(boost::shared_ptr<ClientConnection> client);
+        void Replay(boost::shared_ptr<ClientConnection> client);
+        bool IsSubscribed(boost::shared_ptr<ClientConnection> client, const char* message, std::size_t size);
+        void RejectClient(boost::shared_ptr<ClientConnection> client);
+        void CloseClient(boost::shared_ptr<ClientConnection> client);
+        bool ApplySlowConsumerPolicy(boost::shared_ptr<ClientConnection> client);
+        void ConflateQueue(boost::shared_ptr<ClientConnection> client);
+        void DropOldest(boost::shared_ptr<ClientConnection> client, std::size_t target_bytes);
+        void ReportClient(boost::shared_ptr<ClientConnection> client);
+        void RegisterClient(boost::shared_ptr<ClientConnection> client);
+        bool UnregisterClient(boost::shared_ptr<ClientConnection> client);
+        void QueueFrame(boost::shared_ptr<ClientConnection> client,
+                        boost::shared_ptr<const std::string> frame);
+        void StartWrite(boost::shared_ptr<ClientConnection> client);
         void WriteHandler(const boost::system::error_code& error,
                           std::size_t bytes_transferred,
-                          boost::shared_ptr<boost::asio::ip::tcp::socket> soc);
+                          boost::shared_ptr<ClientConnection> client);
 
         // sub only
+        boost::shared_ptr<ServerConnector> Connector(const Connection& con);
+        void StartConnect(boost::shared_ptr<ServerConnector> connector);
+        void ScheduleConnect(boost::shared_ptr<ServerConnector> connector);
+        void ConnectTimerHandler(const boost::system::error_code& error,
+                                 boost::shared_ptr<ServerConnector> connector);
         void AddServer(const boost::system::error_code& error,
                        boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
-                       boost::asio::ip::tcp::endpoint endpoint,
-                       boost::shared_ptr<std::string> server,
-                       boost::shared_ptr<std::string> ip,
-                       boost::shared_ptr<std::string> port);
-        void ReadHandler(const boost::system::error_code& error,
-                         std::size_t bytes_transferred,
-                         boost::shared_ptr <boost::array<char, 30> > buffer,
-                         boost::shared_ptr <std::string> server_name,
-                         boost::shared_ptr<boost::asio::ip::tcp::socket> soc);
+                       boost::shared_ptr<ServerConnector> connector);
+        void SendResumeRequest(boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                               const std::string& server);
+        void SendControl(boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                         boost::shared_ptr<std::string> frames);
+        void ControlRequestHandler(const boost::system::error_code& error,
+                                   boost::shared_ptr<std::string> frames);
+        void UpdateSubscription(const std::string& server, const std::string& pattern, ControlType type);
+        void RequestReplay(const std::string& server, boost::uint64_t first_sequence, boost::uint64_t last_sequence);
+        void ReadHeaderHandler(const boost::system::error_code& error,
+                               std::size_t bytes_transferred,
+                               boost::shared_ptr< std::vector<char> > buffer,
+                               boost::shared_ptr<std::string> server_name,
+                               boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                               boost::shared_ptr<PublisherCache> publishers);
+        void ReadPayloadHandler(const boost::system::error_code& error,
+                                std::size_t bytes_transferred,
+                                boost::shared_ptr< std::vector<char> > buffer,
+                                boost::shared_ptr<std::string> server_name,
+                                boost::shared_ptr<boost::asio::ip::tcp::socket> soc,
+                                boost::shared_ptr<PublisherCache> publishers);
+        void RemoveServer(boost::shared_ptr<std::string> server_name,
+                          boost::shared_ptr<boost::asio::ip::tcp::socket> soc);
+        void StartReceive(boost::shared_ptr<MulticastReceiver> receiver);
+        void ReceiveHandler(const boost::system::error_code& error,
+                            std::size_t bytes_transferred,
+                            boost::shared_ptr<MulticastReceiver> receiver);
+        void ReadSharedRing(boost::shared_ptr<PublisherState> connection, std::string name);
+        boost::shared_ptr<PublisherState> FindPublisher(const std::string& id, bool is_created);
+        PublisherState& ResolvePublisher(StringRef id, PublisherCache& publishers);
+        bool TrackSequence(const std::vector<char>& payload, PublisherCache& publishers,
+                           boost::shared_ptr<PublisherLatency>& latency);
+        bool RemoveGap(std::deque< std::pair<boost::uint64_t, boost::uint64_t> >& gaps, boost::uint64_t sequence);
+        void PushMessage(std::vector<char>& payload, PublisherCache& publishers);
+        void ReportPercentiles(const std::string& server, const char* stage, const HdrHistogram& histogram);
 
         // common boost::asio members
         boost::shared_ptr<boost::asio::io_service> io_service_;
         boost::shared_ptr<boost::asio::io_service::work> work_;
         std::vector< boost::shared_ptr<boost::asio::ip::tcp::socket> > sockets_;
+        std::vector< boost::shared_ptr<boost::asio::io_service> > io_services_;     // optional per-core pool for connections
+        std::vector< boost::shared_ptr<boost::asio::io_service::work> > works_;     // keep the pool running
+        boost::atomic<unsigned> next_io_service_;                                   // round-robin pool index
 
         // common thread-safety members
         boost::thread_group communication_threads_; // io_service threads
         boost::mutex out_mutex_,                    // terminal output mutex
-                     com_mutex_;                    // pub/sub mutex
+                     com_mutex_;                    // sub's server list mutex
+        std::string id_;                            // pub/sub id, for the metrics
+        boost::shared_ptr<MetricsExporter> metrics_; // set when exporting metrics
+        std::size_t max_message_size_;              // largest message (frame payload) written or read
 
         // pub only
         boost::shared_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+        boost::shared_ptr<const ClientList> clients_;  // connected subscribers, replaced (copy-on-write) on every change
+        boost::mutex registry_mutex_;                  // serialises clients_ replacements
+        boost::shared_ptr<boost::asio::ip::udp::socket> multicast_socket_;  // set when publishing to a group
+        boost::asio::ip::udp::endpoint multicast_endpoint_;                 // the group address and port
+        boost::shared_ptr<SharedRing> shared_ring_;                         // set when publishing to co-located subs
+        bool is_tcp_fanout_;                                                // also send every message over TCP
+        boost::atomic<long> pending_frames_;                                // frames queued to clients, not yet written
+        boost::atomic<unsigned long> written_messages_,                     // messages published
+                                     written_frames_;                       // frames written to clients
+        boost::atomic<boost::uint64_t> written_bytes_;                      // bytes written to clients
+        LatencyHistogram write_latency_;                                    // per gather write, all clients
+        std::size_t high_watermark_,                                        // queued bytes that make a client slow
+                    low_watermark_;                                         // queued bytes a slow client is brought to
+        SlowConsumerPolicy slow_consumer_policy_;                           // what to do with a slow client
+        ReplayRing replay_;                                                 // recent frames, by sequence number
+        std::size_t replay_capacity_;                                       // most frames kept in replay_
+        boost::mutex replay_mutex_;                                         // orders replays against live fan-out
+        boost::shared_ptr<Journal> journal_;                                // set when journaling, serves catch-ups
 
         // sub only
-        bool is_pending_add_,           // flag for a pending server add
-             is_picked_message_,        // flag for message_ process
-             is_set_message_;           // flag for message_ assignment
+        bool is_pending_add_;           // flag for a pending server add
 
-        std::string message_;           // shared resource for reads
-        boost::mutex message_mutex_;    // mutex for message_ access
+        boost::shared_ptr< boost::lockfree::queue<ReceivedMessage*> > messages_;   // bounded queue of read messages
+        boost::atomic<long> queue_depth_,                                      // messages currently queued
+                            max_queue_depth_;                                  // highest queue depth seen
+        boost::atomic<int> waiting_processors_;                                // threads in WaitMessage (PushMessage skips notifying if 0)
+        boost::mutex message_queue_mutex_;                                     // mutex for setting_message_condition_
+        boost::atomic<unsigned long> server_connections_;                      // TCP connections made (shared rings re-check on a new one)
+        boost::atomic<unsigned long> dropped_messages_,                        // messages dropped on a full queue
+                                     missing_messages_,                        // sequence numbers never received
+                                     duplicate_messages_,                      // messages received twice
+                                     recovered_messages_;                      // missing messages replayed over TCP
+        std::map<std::string, boost::shared_ptr<PublisherState> > publishers_; // state per publisher
+        boost::uint64_t catch_up_sequence_;                                    // first sequence wanted from a new pub
+        int catch_up_seconds_;                                                 // or catch up on this many seconds
+        std::map<std::string, boost::shared_ptr<ServerConnector> > connectors_; // connection state per publisher
+        int reconnect_initial_ms_,                                             // first backoff delay
+            reconnect_max_ms_;                                                 // backoff delay cap
+        unsigned reconnect_max_attempts_;                                      // failures before giving up, 0: never
+        boost::random::mt19937 reconnect_random_;                              // backoff jitter
+        boost::mutex reconnect_mutex_;                                         // mutex for connectors_ and reconnect_random_
+        boost::mutex publishers_mutex_;                                        // mutex for publishers_ (not taken per message)
+        std::vector< boost::shared_ptr<MulticastReceiver> > receivers_;       // joined multicast groups
         std::vector<bool> is_reading_;  // flags for recently added server sockets
-        std::vector< boost::shared_ptr <boost::array<char, 30> > > buf_;         // pointers to read buffers
+        std::vector< boost::shared_ptr< std::vector<char> > > buf_;              // pointers to read buffers
+        std::vector< boost::shared_ptr<PublisherCache> > publisher_caches_;      // publishers seen per server
         std::vector< boost::shared_ptr <std::string> > servers_;                 // pointers to server names
         std::vector<Connection> connections_;                                    // connection data for servers
         boost::condition_variable pending_add_condition_;                        // condition for pending add
         boost::shared_ptr<boost::condition_variable> pending_first_condition_,   // condition for first connection
-                                                     setting_message_condition_, // condition for setting message
-                                                     getting_message_condition_; // condition for getting message
+                                                     setting_message_condition_; // condition for queued messages
 
 };
 
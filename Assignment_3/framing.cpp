@@ -0,0 +1,54 @@
+#include "framing.h"
+
+/*
+ * Builds a frame for a payload
+ *  - @payload: the message, of any size up to 4 GiB
+ */
+std::string EncodeFrame(const std::string& payload)
+{
+    std::string frame(kFrameHeaderSize, '\0');
+    frame.reserve(kFrameHeaderSize + payload.size());
+    EncodeFrameHeader(&frame[0], payload.size());
+    frame.append(payload);
+
+    return frame;
+}
+
+/*
+ * Writes the header of a frame in front of its payload
+ *  - @header: kFrameHeaderSize bytes
+ */
+void EncodeFrameHeader(char* header, std::size_t payload_size)
+{
+    boost::uint32_t length = payload_size;
+
+    header[0] = static_cast<char>(kFrameVersion);
+    header[1] = static_cast<char>((length >> 24) & 0xFF);
+    header[2] = static_cast<char>((length >> 16) & 0xFF);
+    header[3] = static_cast<char>((length >> 8) & 0xFF);
+    header[4] = static_cast<char>(length & 0xFF);
+}
+
+/*
+ * Decodes a frame header
+ *  - @header: kFrameHeaderSize bytes received
+ *  - @max_payload_size: the largest payload accepted
+ *  - @payload_size: set to the payload length
+ *  - returns false on an unknown version or an oversized payload
+ */
+bool DecodeFrameHeader(const char* header, std::size_t max_payload_size, std::size_t& payload_size)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(header);
+
+    if (bytes[0] != kFrameVersion)
+    {
+        return false;
+    }
+
+    payload_size = (static_cast<boost::uint32_t>(bytes[1]) << 24) |
+                   (static_cast<boost::uint32_t>(bytes[2]) << 16) |
+                   (static_cast<boost::uint32_t>(bytes[3]) << 8) |
+                    static_cast<boost::uint32_t>(bytes[4]);
+
+    return payload_size <= max_payload_size;
+}
@@ -0,0 +1,22 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+#include <string>
+#include <boost/cstdint.hpp>
+
+/*
+ * Wire framing for network messages
+ *  - frame: [version: 1 byte][payload length: 4 bytes, big-endian][payload]
+ *  - the receiving side checks the version and bounds the length before reading the payload
+ */
+const unsigned char kFrameVersion = 1;       // current protocol version
+const std::size_t kFrameHeaderSize = 5;      // version + length
+const std::size_t kDefaultMaxMessageSize = 65536;
+
+std::string EncodeFrame(const std::string& payload);  // prepends the frame header
+void EncodeFrameHeader(char* header,
+                       std::size_t payload_size);     // writes a frame header in place
+bool DecodeFrameHeader(const char* header,
+                       std::size_t max_payload_size,
+                       std::size_t& payload_size);    // validates a header, extracts the payload length
+
+#endif // FRAMING_H
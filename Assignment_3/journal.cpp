@@ -0,0 +1,401 @@
+#include "journal.h"
+
+/*
+ * Opens the journal in a directory, creating it if needed
+ *  - @directory: holds one file per segment
+ *  - @segment_size: the size of new segment files (the largest record)
+ *  - @sync_every, @sync_interval_ms: the sync policy (0 to disable each)
+ *  - existing segments are mapped and scanned to rebuild the index
+ */
+Journal::Journal(const std::string& directory,
+                 std::size_t segment_size,
+                 std::size_t sync_every,
+                 int sync_interval_ms) : directory_(directory),
+                                         segment_size_(segment_size),
+                                         sync_every_(sync_every),
+                                         sync_interval_ms_(sync_interval_ms),
+                                         write_offset_(0),
+                                         synced_offset_(0),
+                                         unsynced_count_(0),
+                                         indexed_count_(kJournalIndexInterval),
+                                         last_sync_(boost::chrono::steady_clock::now()),
+                                         last_sequence_(0)
+{
+    // the directory may already exist
+    mkdir(directory_.c_str(), 0755);
+
+    DIR* dir = opendir(directory_.c_str());
+    if (!dir)
+    {
+        throw std::runtime_error("cannot open journal directory " + directory_);
+    }
+
+    // collect the segments, named after their first sequence number
+    std::vector<boost::uint64_t> first_sequences;
+    while (dirent* entry = readdir(dir))
+    {
+        unsigned long long first_sequence = 0;
+        char extension[16] = "";
+        if (std::sscanf(entry->d_name, "%20llu.%15s", &first_sequence, extension) == 2 &&
+            std::string(extension) == "journal")
+        {
+            first_sequences.push_back(first_sequence);
+        }
+    }
+    closedir(dir);
+
+    std::sort(first_sequences.begin(), first_sequences.end());
+    for (unsigned i=0; i<first_sequences.size(); i++)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu.journal", static_cast<unsigned long long>(first_sequences[i]));
+
+        segments_.push_back(MapSegment(directory_ + "/" + name, first_sequences[i]));
+        Recover(segments_.back());
+    }
+}
+
+/*
+ * Syncs what is left
+ */
+Journal::~Journal()
+{
+    Sync();
+}
+
+/*
+ * Appends a message
+ *  - @sequence, @timestamp_ns: the message's sequence number and time, for the index
+ *  - starts a new segment when the current one is full
+ *  - returns false if the message is larger than a segment
+ */
+bool Journal::Append(boost::uint64_t sequence,
+                     boost::int64_t timestamp_ns,
+                     const std::string& message)
+{
+    std::size_t record_size = kJournalRecordHeaderSize + message.size();
+    if (record_size > segment_size_)
+    {
+        return false;
+    }
+
+    if (segments_.empty() || write_offset_ + record_size > segments_.back()->size)
+    {
+        AddSegment(sequence);
+    }
+
+    // write the record, its size last so that a torn write reads as the end of data
+    char* record = segments_.back()->data + write_offset_;
+    boost::uint32_t size = message.size();
+    std::memcpy(record + 4, &sequence, sizeof(sequence));
+    std::memcpy(record + 12, &timestamp_ns, sizeof(timestamp_ns));
+    std::memcpy(record + kJournalRecordHeaderSize, message.data(), message.size());
+    boost::atomic_thread_fence(boost::memory_order_release);
+    std::memcpy(record, &size, sizeof(size));
+
+    if (indexed_count_ >= kJournalIndexInterval)
+    {
+        JournalIndexEntry entry = {sequence, timestamp_ns, segments_.size() - 1, write_offset_};
+        index_mutex_.lock();
+        index_.push_back(entry);
+        index_mutex_.unlock();
+        indexed_count_ = 0;
+    }
+    indexed_count_++;
+
+    write_offset_ += record_size;
+    last_sequence_.store(sequence, boost::memory_order_release);
+
+    // apply the sync policy
+    unsynced_count_++;
+    if ((sync_every_ > 0 && unsynced_count_ >= sync_every_) ||
+        (sync_interval_ms_ > 0 &&
+         boost::chrono::steady_clock::now() - last_sync_ >= boost::chrono::milliseconds(sync_interval_ms_)))
+    {
+        Sync();
+    }
+
+    return true;
+}
+
+/*
+ * Flushes the records appended since the last sync to disk
+ *  - appender only
+ */
+void Journal::Sync()
+{
+    if (segments_.empty() || synced_offset_ == write_offset_)
+    {
+        return;
+    }
+
+    std::size_t page_size = boost::interprocess::mapped_region::get_page_size();
+    std::size_t start = synced_offset_ / page_size * page_size;
+    msync(segments_.back()->data + start, write_offset_ - start, MS_SYNC);
+
+    synced_offset_ = write_offset_;
+    unsynced_count_ = 0;
+    last_sync_ = boost::chrono::steady_clock::now();
+}
+
+/*
+ * Copies messages out of the mapped segments
+ *  - @from_sequence: the first sequence wanted (the oldest kept if it is older)
+ *  - @max_count: the most messages copied
+ *  - @messages: the messages are appended to it
+ *  - @headroom: bytes left (zeroed) in front of each message, e.g. for a frame header
+ *  - returns the sequence of the last message copied, 0 if none
+ */
+boost::uint64_t Journal::Read(boost::uint64_t from_sequence,
+                              std::size_t max_count,
+                              std::vector<std::string>& messages,
+                              std::size_t headroom)
+{
+    boost::uint64_t last_sequence = last_sequence_.load(boost::memory_order_acquire);
+    boost::uint64_t last_read = 0;
+
+    boost::shared_ptr<JournalSegment> segment;
+    std::size_t segment_index = 0,
+                offset = 0,
+                count = 0;
+    if (!Locate(from_sequence, 0, segment, segment_index, offset))
+    {
+        return 0;
+    }
+
+    while (count < max_count)
+    {
+        boost::uint32_t size = 0;
+        if (offset + kJournalRecordHeaderSize <= segment->size)
+        {
+            std::memcpy(&size, segment->data + offset, sizeof(size));
+        }
+
+        // end of this segment, go on with the next one
+        if (size == 0)
+        {
+            boost::mutex::scoped_lock index_lock(index_mutex_);
+            if (segment_index + 1 >= segments_.size())
+            {
+                break;
+            }
+            segment = segments_[++segment_index];
+            offset = 0;
+            continue;
+        }
+
+        boost::uint64_t sequence;
+        std::memcpy(&sequence, segment->data + offset + 4, sizeof(sequence));
+        if (sequence > last_sequence)
+        {
+            break;
+        }
+
+        if (sequence >= from_sequence)
+        {
+            // the only copy: straight from the mapped segment
+            messages.push_back(std::string());
+            messages.back().reserve(headroom + size);
+            messages.back().assign(headroom, '\0');
+            messages.back().append(segment->data + offset + kJournalRecordHeaderSize, size);
+            last_read = sequence;
+            count++;
+        }
+        offset += kJournalRecordHeaderSize + size;
+    }
+
+    return last_read;
+}
+
+/*
+ * Finds the first message at or after a time
+ *  - returns its sequence, or the next sequence to be written if there is none
+ */
+boost::uint64_t Journal::SequenceAt(boost::int64_t timestamp_ns)
+{
+    boost::uint64_t last_sequence = last_sequence_.load(boost::memory_order_acquire);
+
+    boost::shared_ptr<JournalSegment> segment;
+    std::size_t segment_index = 0,
+                offset = 0;
+    if (!Locate(0, timestamp_ns, segment, segment_index, offset))
+    {
+        return last_sequence + 1;
+    }
+
+    for (;;)
+    {
+        boost::uint32_t size = 0;
+        if (offset + kJournalRecordHeaderSize <= segment->size)
+        {
+            std::memcpy(&size, segment->data + offset, sizeof(size));
+        }
+
+        // end of this segment, go on with the next one
+        if (size == 0)
+        {
+            boost::mutex::scoped_lock index_lock(index_mutex_);
+            if (segment_index + 1 >= segments_.size())
+            {
+                break;
+            }
+            segment = segments_[++segment_index];
+            offset = 0;
+            continue;
+        }
+
+        boost::uint64_t sequence;
+        boost::int64_t timestamp;
+        std::memcpy(&sequence, segment->data + offset + 4, sizeof(sequence));
+        std::memcpy(&timestamp, segment->data + offset + 12, sizeof(timestamp));
+        if (sequence > last_sequence)
+        {
+            break;
+        }
+        if (timestamp >= timestamp_ns)
+        {
+            return sequence;
+        }
+        offset += kJournalRecordHeaderSize + size;
+    }
+
+    return last_sequence + 1;
+}
+
+
+
+// ----- Private functions -----
+
+/*
+ * Maps a segment file, creating and preallocating it if needed
+ */
+boost::shared_ptr<JournalSegment> Journal::MapSegment(const std::string& path, boost::uint64_t first_sequence)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("cannot open journal segment " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 ||
+        (file_stat.st_size == 0 && ftruncate(fd, segment_size_) != 0))
+    {
+        close(fd);
+        throw std::runtime_error("cannot size journal segment " + path);
+    }
+    close(fd);
+
+    boost::shared_ptr<JournalSegment> segment(new JournalSegment);
+    segment->first_sequence = first_sequence;
+    boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_write);
+    segment->file.swap(file);
+    boost::interprocess::mapped_region region(segment->file, boost::interprocess::read_write);
+    segment->region.swap(region);
+    segment->data = static_cast<char*>(segment->region.get_address());
+    segment->size = segment->region.get_size();
+
+    return segment;
+}
+
+/*
+ * Starts a new segment, after syncing the current one
+ */
+void Journal::AddSegment(boost::uint64_t first_sequence)
+{
+    Sync();
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu.journal", static_cast<unsigned long long>(first_sequence));
+    boost::shared_ptr<JournalSegment> segment = MapSegment(directory_ + "/" + name, first_sequence);
+
+    index_mutex_.lock();
+    segments_.push_back(segment);
+    index_mutex_.unlock();
+
+    write_offset_ = 0;
+    synced_offset_ = 0;
+    indexed_count_ = kJournalIndexInterval;
+}
+
+/*
+ * Scans a segment found on open, rebuilding the index and the append position
+ */
+void Journal::Recover(boost::shared_ptr<JournalSegment> segment)
+{
+    std::size_t offset = 0;
+    indexed_count_ = kJournalIndexInterval;
+
+    while (offset + kJournalRecordHeaderSize <= segment->size)
+    {
+        boost::uint32_t size;
+        std::memcpy(&size, segment->data + offset, sizeof(size));
+        if (size == 0 || offset + kJournalRecordHeaderSize + size > segment->size)
+        {
+            break;
+        }
+
+        boost::uint64_t sequence;
+        boost::int64_t timestamp_ns;
+        std::memcpy(&sequence, segment->data + offset + 4, sizeof(sequence));
+        std::memcpy(&timestamp_ns, segment->data + offset + 12, sizeof(timestamp_ns));
+
+        if (indexed_count_ >= kJournalIndexInterval)
+        {
+            JournalIndexEntry entry = {sequence, timestamp_ns, segments_.size() - 1, offset};
+            index_.push_back(entry);
+            indexed_count_ = 0;
+        }
+        indexed_count_++;
+
+        last_sequence_.store(sequence);
+        offset += kJournalRecordHeaderSize + size;
+    }
+
+    write_offset_ = offset;
+    synced_offset_ = offset;
+}
+
+/*
+ * Finds where to start scanning for a sequence number or a time
+ *  - @sequence: used when @timestamp_ns is 0, the last index entry at or before it
+ *  - @timestamp_ns: otherwise, the last index entry before it
+ *  - returns false if the journal is empty
+ */
+bool Journal::Locate(boost::uint64_t sequence,
+                     boost::int64_t timestamp_ns,
+                     boost::shared_ptr<JournalSegment>& segment,
+                     std::size_t& segment_index,
+                     std::size_t& offset)
+{
+    boost::mutex::scoped_lock index_lock(index_mutex_);
+    if (index_.empty())
+    {
+        return false;
+    }
+
+    std::size_t found = 0,
+                low = 0,
+                high = index_.size();
+    while (low < high)
+    {
+        std::size_t middle = (low + high) / 2;
+        bool is_before = (timestamp_ns > 0) ? (index_[middle].timestamp_ns < timestamp_ns)
+                                            : (index_[middle].sequence <= sequence);
+        if (is_before)
+        {
+            found = middle;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    segment_index = index_[found].segment;
+    offset = index_[found].offset;
+    segment = segments_[segment_index];
+
+    return true;
+}
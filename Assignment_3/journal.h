@@ -0,0 +1,111 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/chrono.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+const std::size_t kJournalRecordHeaderSize = 20;           // size (4), sequence (8), timestamp (8)
+const std::size_t kDefaultJournalSegmentSize = 16 << 20;   // bytes per segment file
+const std::size_t kJournalIndexInterval = 64;              // records between index entries
+
+/*
+ * A memory-mapped journal file
+ *  - named after its first sequence number, preallocated to the segment size
+ *  - records: [size: 4][sequence: 8][timestamp ns: 8][message], a zero size ends the data
+ */
+struct JournalSegment
+{
+    boost::uint64_t first_sequence;
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    char* data;
+    std::size_t size;
+};
+
+/*
+ * Sparse index entry, one per kJournalIndexInterval records and per segment start
+ */
+struct JournalIndexEntry
+{
+    boost::uint64_t sequence;
+    boost::int64_t timestamp_ns;
+    std::size_t segment;
+    std::size_t offset;
+};
+
+/*
+ * Durable, segmented, append-only message journal
+ *  - one appender (the publishing thread), any number of concurrent readers
+ *  - readers copy straight from the mapped segments and only see complete records
+ *  - reopening the directory restores the journal, so a restarted publisher keeps its history
+ *  - sync policy: msync after every @sync_every records and/or every @sync_interval_ms
+ *    (checked on append), none if both are 0
+ */
+class Journal : boost::noncopyable
+{
+    public:
+        Journal(const std::string& directory,
+                std::size_t segment_size,
+                std::size_t sync_every,
+                int sync_interval_ms);               // opens or creates the journal, throws on failure
+        ~Journal();
+
+        bool Append(boost::uint64_t sequence,
+                    boost::int64_t timestamp_ns,
+                    const std::string& message);
+        void Sync();
+        boost::uint64_t Read(boost::uint64_t from_sequence,
+                             std::size_t max_count,
+                             std::vector<std::string>& messages,
+                             std::size_t headroom = 0);
+        boost::uint64_t SequenceAt(boost::int64_t timestamp_ns);
+
+        // accessors
+        boost::uint64_t last_sequence() const {return last_sequence_.load(boost::memory_order_acquire);}
+
+    private:
+        boost::shared_ptr<JournalSegment> MapSegment(const std::string& path, boost::uint64_t first_sequence);
+        void AddSegment(boost::uint64_t first_sequence);
+        void Recover(boost::shared_ptr<JournalSegment> segment);
+        bool Locate(boost::uint64_t sequence,
+                    boost::int64_t timestamp_ns,
+                    boost::shared_ptr<JournalSegment>& segment,
+                    std::size_t& segment_index,
+                    std::size_t& offset);
+
+        std::string directory_;
+        std::size_t segment_size_,
+                    sync_every_;
+        int sync_interval_ms_;
+
+        // appender state
+        std::size_t write_offset_,          // end of the data in the last segment
+                    synced_offset_,         // end of the synced data in the last segment
+                    unsynced_count_,        // records appended since the last sync
+                    indexed_count_;         // records appended since the last index entry
+        boost::chrono::steady_clock::time_point last_sync_;
+
+        // shared with readers
+        boost::atomic<boost::uint64_t> last_sequence_;                 // last complete record
+        std::vector< boost::shared_ptr<JournalSegment> > segments_;    // all segments, oldest first
+        std::vector<JournalIndexEntry> index_;                         // sparse index, by sequence
+        boost::mutex index_mutex_;                                     // mutex for segments_ and index_
+};
+
+#endif // JOURNAL_H
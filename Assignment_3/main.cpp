@@ -1,7 +1,7 @@
 /* ---------------------------------------------------------------------------------
  * Publishers-Subscribers NETWORK demo
  *   - main function resides here
- *   - launches a single publisher or a single subscriber
+ *   - launches a single publisher, subscriber or broker
  *   - arguements are passed through the corresponding configuration file
  *   - programme runs INFINATE LOOPS (press ENTER in the active terminal to exit)
  *
@@ -11,16 +11,140 @@
  *             e.g.  1st arguement: file_name.config
  *
  * ---------------------------------------------------------------------------------
- * NOTES: (1) in PUB configuration file, the threads count should be at least two,
- *            as there should always be a thread available for accepting clients
+ * NOTES: (1) in PUB configuration file, the threads count should be at least one;
+ *            messages are produced on a separate thread, every upper_bound_ms (or
+ *            at random intervals up to it), at a fixed rate in messages per second,
+ *            or as fast as the subscribers take them
  *
- *                  e.g. <local ... communication_threads_count = "2"/>
+ *                  e.g. <local ... communication_threads_count = "1"/>
  *
- *        (2) in SUB configuration file, the threads count should be at least three,
- *            as there should always be a thread available for connecting to servers
- *            and one thread for the message display
+ *                  e.g. <data_production rand_intervals = "false" upper_bound_ms = "100"
+ *                                        rate = "10000"/>          (or rate = "unlimited")
  *
- *                  e.g. <local ... communication_threads_count = "3"/>
+ *            the text payload may be padded (or cut) to a size in bytes (default 0: as is)
+ *
+ *                  e.g. <data_production ... payload_bytes = "1024"/>
+ *
+ *        (2) in SUB configuration file, the threads count should be at least two,
+ *            as there should always be a thread available for connecting to servers;
+ *            messages are displayed by separate processing threads (default 1), fed
+ *            through a bounded queue (default 1024 messages, overflow is dropped)
+ *
+ *                  e.g. <local ... communication_threads_count = "3"
+ *                                  processing_threads_count = "1"
+ *                                  message_queue_capacity = "1024"/>
+ *
+ *        (3) messages travel as length-prefixed frames; both PUB and SUB may cap
+ *            the message size in bytes (default 65536), larger frames are refused
+ *
+ *                  e.g. <local ... max_message_bytes = "65536"/>
+ *
+ *        (4) a PUB keeps its latest messages (default 1024) for SUBs that reconnect;
+ *            a SUB asks for the messages after the last one it received
+ *
+ *                  e.g. <local ... replay_buffer_size = "1024"/>
+ *
+ *            a PUB may also keep all its messages in a journal directory (synced
+ *            every N messages and/or every N ms, 0 for never), and a SUB may then
+ *            catch up on a new PUB from a sequence number or the last N seconds
+ *
+ *                  e.g. <journal directory = "journal_pub_1" segment_size = "16777216"
+ *                                sync_every = "0" sync_interval_ms = "1000"/>
+ *
+ *                  e.g. <local ... catch_up_sequence = "1"/>
+ *                       <local ... catch_up_seconds = "60"/>
+ *
+ *        (5) both PUB and SUB may run their connections on a pool of io_services,
+ *            one thread pinned to a core per io_service (default 0: no pool, all
+ *            connections share the communication threads)
+ *
+ *                  e.g. <local ... io_service_pool_size = "4"/>
+ *
+ *        (6) a PUB may send each message once to a UDP multicast group (loopback by
+ *            default); TCP subscribers get every message too only with tcp_fanout,
+ *            frames must then fit a datagram (65507 bytes)
+ *
+ *                  e.g. <multicast group = "239.255.0.1" port = "30001"
+ *                                  interface = "127.0.0.1" tcp_fanout = "false"/>
+ *
+ *            a SUB joins the group per publisher, sequence numbers drop duplicates
+ *            and count the missing messages; it asks the PUB for those again over its
+ *            TCP connection, which replays them from its replay buffer
+ *
+ *                  e.g. <publisher ... multicast_group = "239.255.0.1"
+ *                                      multicast_port = "30001"/>
+ *
+ *        (7) a PUB may also write each message once to a shared-memory ring, read
+ *            by the SUBs on the same host (messages larger than a slot go over TCP);
+ *            a SUB re-opens the ring once a restarted PUB recreated it, and asks for
+ *            the messages overwritten before it read them like for multicast (6)
+ *
+ *                  e.g. <shared_memory name = "pub_1_ring" slots = "4096"
+ *                                      slot_size = "512" tcp_fanout = "false"/>
+ *
+ *                  e.g. <publisher ... shared_ring = "pub_1_ring"/>
+ *
+ *        (8) a PUB treats a SUB with more than high_watermark_bytes queued (default
+ *            8 MB) as slow, and then disconnects it (default), drops its oldest
+ *            queued messages down to low_watermark_bytes (default 2 MB), keeps only
+ *            its newest queued message per topic, or pauses it (new messages are
+ *            skipped) until it drains down to low_watermark_bytes; a catch-up is sent
+ *            at the SUB's pace, about low_watermark_bytes at a time
+ *
+ *                  e.g. <slow_consumer high_watermark_bytes = "8388608"
+ *                                      low_watermark_bytes = "2097152"
+ *                                      policy = "disconnect"/>   (or drop_oldest, conflate, pause)
+ *
+ *        (9) a SUB retries a publisher that is down or goes away after a delay that
+ *            doubles per failed attempt (default 100 ms up to 10000 ms, randomised
+ *            between half and all of it), and may give up after N attempts (default
+ *            0: never)
+ *
+ *                  e.g. <reconnect initial_ms = "100" max_ms = "10000" max_attempts = "0"/>
+ *
+ *       (10) a PUB may publish several topics in turn (default: its id), and a SUB
+ *            may subscribe to some of them per publisher (levels are separated by
+ *            '.', "*" matches one level and "#" any number of levels);
+ *            the PUB then only sends the matching messages over TCP
+ *
+ *                  e.g. <data_production ... topics = "prices,news.eu,news.us"/>
+ *
+ *                  e.g. <publisher ... topics = "prices,news.*"/>
+ *
+ *       (11) both PUB and SUB may export counters and latency histograms (messages,
+ *            bytes, queue depths, write latency, connection attempts, drops), per
+ *            process and per connection, as Prometheus text on a local HTTP port
+ *            and/or as a JSON file rewritten every interval_ms (default 1000); a SUB
+ *            may display only one message in N (default 1, 0 for none)
+ *
+ *                  e.g. <metrics port = "9100" file = "pub_1_metrics.json" interval_ms = "1000"/>
+ *
+ *                  e.g. <local ... display_every = "1000"/>
+ *
+ *       (12) messages carry their publisher's send time (steady clock, so publisher and
+ *            subscriber should share a host); a SUB records per publisher the publish
+ *            to receive and receive to process latency, exports their percentiles with
+ *            the metrics (11), reports them on exit and on "l" + <RETURN>; catch-up
+ *            messages count from their original send time
+ *
+ *       (13) a BROKER subscribes to upstream PUBs (or BROKERs) once and re-publishes
+ *            their messages unchanged to its own SUBs (or BROKERs), so brokers chain
+ *            into a tree; upstream is set up as in a SUB configuration file (at least
+ *            two upstream threads, remote_connections with optional topics, reconnect,
+ *            catch-up), downstream as in a PUB's (threads, listening port,
+ *            slow_consumer); SUBs may subscribe to topics through it as to a PUB
+ *
+ *                  e.g. <local role = "broker" id = "broker_1" listening_port = "7777"
+ *                                  communication_threads_count = "2"
+ *                                  upstream_threads_count = "2"/>
+ *                       <remote_connections count = "1">
+ *                           <publisher id = "pub_1" ip = "127.0.0.1" port = "5555"/>
+ *                       </remote_connections>
+ *
+ *            a broker keeps no replay ring (replay_buffer_size is rejected): the
+ *            sequence numbers of the PUBs it relays are unrelated, so a SUB (or
+ *            BROKER) connecting to it, or reconnecting, gets live messages only;
+ *            the broker itself catches up from its upstream PUBs as a SUB does
  *
  * ---------------------------------------------------------------------------------
  * Author: Dimitris Saliaris
@@ -32,14 +156,26 @@
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
 #include <fstream>
 #include "publisher.h"
 #include "subscriber.h"
+#include "broker.h"
 #include "options.h"
 
 bool FileIsValid(std::string file_name);  // Validates config-file arguement
+std::vector<std::string> SplitTopics(std::string topics);  // splits a comma-separated topic list
 void SetOptions(PubOptions& options, boost::property_tree::ptree opt);  // xml parser for pub
 void SetOptions(SubOptions& options, boost::property_tree::ptree opt);  // xml parser for sub
+void SetOptions(BrokerOptions& options, boost::property_tree::ptree opt);  // xml parser for broker
+void SetSlowConsumer(std::size_t& high_watermark_bytes,
+                     std::size_t& low_watermark_bytes,
+                     SlowConsumerPolicy& slow_consumer_policy,
+                     boost::property_tree::ptree opt);  // slow_consumer options
+void SetReconnect(int& initial_ms, int& max_ms, unsigned& max_attempts,
+                  boost::property_tree::ptree opt);  // reconnect options
+void SetConnections(int& connections_count, std::vector<Connection>& pubs,
+                    boost::property_tree::ptree opt);  // remote_connections
 
 /*
  * main:
@@ -74,14 +210,17 @@ int main(int argc, char *argv[])
         pub.set_id(options.pub_id);
         pub.set_rand_intervals(options.rand_intervals);
         pub.set_upper_bound_ms(options.upper_bound_ms);
+        pub.set_topics(options.topics);
+        pub.set_rate(options.rate);
+        pub.set_unlimited_rate(options.unlimited_rate);
+        pub.set_payload_size(options.payload_size);
 
         // setup srand for random production time simulation
         srand(time(NULL));
 
         // launch the pub and start publishing
         pub.Launch(options);
-        pub.com()->io_service()->post(boost::bind(&Publisher::PublishData,
-                                                  &pub));
+        pub.StartPublishing();
 
         // listen for exit signal from user
         std::cin.get();
@@ -108,17 +247,46 @@ int main(int argc, char *argv[])
         sub.com()->io_service()->post(boost::bind(&Subscriber::GetMessages,
                                                   &sub));
 
-        // start message display
-        sub.com()->io_service()->post(boost::bind(&Subscriber::DisplayMessages,
-                                                  &sub));
-
-        // listen for exit signal from user
-        std::cin.get();
+        // listen for exit signal from user, "l" reports the latency percentiles
+        std::string command;
+        while (std::getline(std::cin, command) && command == "l")
+        {
+            sub.com()->ReportLatency();
+        }
 
         // clean exit
         sub.Exit();
     }
 
+    // launch a broker
+    else if (opt.get_child("local.<xmlattr>.role").data() == "broker")
+    {
+        // parse xml and set user defined options
+        BrokerOptions options;
+        SetOptions(options, opt);
+
+        // create the broker
+        Broker broker;
+        broker.set_id(options.broker_id);
+
+        // launch the broker
+        broker.Launch(options);
+
+        // start receiving messages from upstream pubs
+        broker.upstream()->io_service()->post(boost::bind(&Broker::GetMessages,
+                                                          &broker));
+
+        // listen for exit signal from user, "l" reports the relay latency percentiles
+        std::string command;
+        while (std::getline(std::cin, command) && command == "l")
+        {
+            broker.upstream()->ReportLatency();
+        }
+
+        // clean exit
+        broker.Exit();
+    }
+
     return 0;
 }
 
@@ -132,6 +300,27 @@ bool FileIsValid(std::string file_name)
     return (extention == ".config");
 }
 
+/*
+ * Splits a comma-separated topic list, dropping empty entries
+ */
+std::vector<std::string> SplitTopics(std::string topics)
+{
+    std::vector<std::string> split;
+    boost::split(split, topics, boost::is_any_of(","));
+
+    std::vector<std::string> result;
+    for (unsigned i=0; i<split.size(); i++)
+    {
+        boost::trim(split[i]);
+        if (!split[i].empty())
+        {
+            result.push_back(split[i]);
+        }
+    }
+
+    return result;
+}
+
 /*
  * Sets user-defined options for a publisher
  */
@@ -141,13 +330,25 @@ void SetOptions(PubOptions& options, boost::property_tree::ptree opt)
     options.pub_id = opt.get_child("local.<xmlattr>.id").data();
     options.port = opt.get_child("local.<xmlattr>.listening_port").data();
     options.threads = boost::lexical_cast<int>(opt.get_child("local.<xmlattr>.communication_threads_count").data());
+    options.max_message_size = opt.get<std::size_t>("local.<xmlattr>.max_message_bytes", kDefaultMaxMessageSize);
+    options.io_service_pool_size = opt.get<int>("local.<xmlattr>.io_service_pool_size", 0);
+    options.replay_buffer_size = opt.get<std::size_t>("local.<xmlattr>.replay_buffer_size", kDefaultReplayBufferSize);
 
-    // check if there are at least two threads available
-    if (!(options.threads > 1))
+    // set journal options (optional)
+    options.journal_directory = opt.get<std::string>("journal.<xmlattr>.directory", "");
+    options.journal_segment_size = opt.get<std::size_t>("journal.<xmlattr>.segment_size", kDefaultJournalSegmentSize);
+    options.journal_sync_every = opt.get<std::size_t>("journal.<xmlattr>.sync_every", 0);
+    options.journal_sync_interval_ms = opt.get<int>("journal.<xmlattr>.sync_interval_ms", 1000);
+
+    // set slow consumer options (optional)
+    SetSlowConsumer(options.high_watermark_bytes, options.low_watermark_bytes, options.slow_consumer_policy, opt);
+
+    // check if there is at least one thread available
+    if (!(options.threads > 0))
     {
         std::cout << "ERROR -> in the configuration file: \n" <<
-                     "communication_threads_count should be at least 2 \n\n" <<
-                     "      e.g. <local ... communication_threads_count = \"2\"/>\n\n";
+                     "communication_threads_count should be at least 1 \n\n" <<
+                     "      e.g. <local ... communication_threads_count = \"1\"/>\n\n";
         exit(-1);
     }
 
@@ -155,6 +356,31 @@ void SetOptions(PubOptions& options, boost::property_tree::ptree opt)
     std::string temp = opt.get_child("data_production.<xmlattr>.rand_intervals").data();
     options.rand_intervals = (temp == "true" ? true : false);
     options.upper_bound_ms = boost::lexical_cast<int>(opt.get_child("data_production.<xmlattr>.upper_bound_ms").data());
+    options.topics = SplitTopics(opt.get<std::string>("data_production.<xmlattr>.topics", ""));
+    std::string rate = opt.get<std::string>("data_production.<xmlattr>.rate", "");
+    options.unlimited_rate = (rate == "unlimited");
+    options.payload_size = opt.get<std::size_t>("data_production.<xmlattr>.payload_bytes", 0);
+
+    // set metrics options (optional)
+    options.metrics_port = opt.get<std::string>("metrics.<xmlattr>.port", "");
+    options.metrics_file = opt.get<std::string>("metrics.<xmlattr>.file", "");
+    options.metrics_interval_ms = opt.get<int>("metrics.<xmlattr>.interval_ms", 1000);
+    options.rate = (rate.empty() || options.unlimited_rate) ? 0 : boost::lexical_cast<double>(rate);
+
+    // set multicast options (optional)
+    options.multicast_group = opt.get<std::string>("multicast.<xmlattr>.group", "");
+    options.multicast_port = opt.get<std::string>("multicast.<xmlattr>.port", "");
+    options.multicast_interface = opt.get<std::string>("multicast.<xmlattr>.interface", "127.0.0.1");
+    options.tcp_fanout = (opt.get<std::string>("multicast.<xmlattr>.tcp_fanout", "false") == "true");
+
+    // set shared-memory ring options (optional)
+    options.shared_ring = opt.get<std::string>("shared_memory.<xmlattr>.name", "");
+    options.shared_ring_slots = opt.get<boost::uint32_t>("shared_memory.<xmlattr>.slots", kDefaultSharedRingSlots);
+    options.shared_ring_slot_size = opt.get<boost::uint32_t>("shared_memory.<xmlattr>.slot_size", kDefaultSharedRingSlotSize);
+    if (!options.shared_ring.empty())
+    {
+        options.tcp_fanout = (opt.get<std::string>("shared_memory.<xmlattr>.tcp_fanout", "false") == "true");
+    }
 }
 
 /*
@@ -165,6 +391,8 @@ void SetOptions(SubOptions& options, boost::property_tree::ptree opt)
     // set some sub options
     options.sub_id = opt.get_child("local.<xmlattr>.id").data();
     options.threads = boost::lexical_cast<int>(opt.get_child("local.<xmlattr>.communication_threads_count").data());
+    options.max_message_size = opt.get<std::size_t>("local.<xmlattr>.max_message_bytes", kDefaultMaxMessageSize);
+    options.io_service_pool_size = opt.get<int>("local.<xmlattr>.io_service_pool_size", 0);
 
     // check if there are at least two threads available
     if (!(options.threads > 1))
@@ -175,8 +403,127 @@ void SetOptions(SubOptions& options, boost::property_tree::ptree opt)
         exit(-1);
     }
 
+    // set message processing options
+    options.processing_threads = opt.get<int>("local.<xmlattr>.processing_threads_count", 1);
+    options.queue_capacity = opt.get<std::size_t>("local.<xmlattr>.message_queue_capacity", kDefaultMessageQueueCapacity);
+    options.catch_up_sequence = opt.get<boost::uint64_t>("local.<xmlattr>.catch_up_sequence", 0);
+    options.catch_up_seconds = opt.get<int>("local.<xmlattr>.catch_up_seconds", 0);
+    options.display_every = opt.get<unsigned long>("local.<xmlattr>.display_every", 1);
+
+    // set metrics options (optional)
+    options.metrics_port = opt.get<std::string>("metrics.<xmlattr>.port", "");
+    options.metrics_file = opt.get<std::string>("metrics.<xmlattr>.file", "");
+    options.metrics_interval_ms = opt.get<int>("metrics.<xmlattr>.interval_ms", 1000);
+
+    // set reconnect options (optional)
+    SetReconnect(options.reconnect_initial_ms, options.reconnect_max_ms, options.reconnect_max_attempts, opt);
+
     // set connection options
-    options.connections_count = boost::lexical_cast<int>(opt.get_child("remote_connections.<xmlattr>.count").data());
+    SetConnections(options.connections_count, options.pubs, opt);
+}
+
+/*
+ * Sets user-defined options for a broker
+ *  - its downstream side is set up as a pub's, its upstream side as a sub's
+ */
+void SetOptions(BrokerOptions& options, boost::property_tree::ptree opt)
+{
+    // set some broker options
+    options.broker_id = opt.get_child("local.<xmlattr>.id").data();
+    options.port = opt.get_child("local.<xmlattr>.listening_port").data();
+    options.threads = boost::lexical_cast<int>(opt.get_child("local.<xmlattr>.communication_threads_count").data());
+    options.upstream_threads = opt.get<int>("local.<xmlattr>.upstream_threads_count", 2);
+    options.max_message_size = opt.get<std::size_t>("local.<xmlattr>.max_message_bytes", kDefaultMaxMessageSize);
+    options.io_service_pool_size = opt.get<int>("local.<xmlattr>.io_service_pool_size", 0);
+    options.queue_capacity = opt.get<std::size_t>("local.<xmlattr>.message_queue_capacity", kDefaultMessageQueueCapacity);
+    options.catch_up_sequence = opt.get<boost::uint64_t>("local.<xmlattr>.catch_up_sequence", 0);
+    options.catch_up_seconds = opt.get<int>("local.<xmlattr>.catch_up_seconds", 0);
+
+    // relayed publishers' sequence numbers cannot be replayed as one stream
+    if (opt.get_optional<std::string>("local.<xmlattr>.replay_buffer_size") || opt.get_child_optional("journal"))
+    {
+        std::cout << "ERROR -> in the configuration file: \n" <<
+                     "a broker keeps no replay buffer or journal, its subscribers resume live only \n\n" <<
+                     "      remove replay_buffer_size from <local .../> and any <journal .../> \n\n";
+        exit(-1);
+    }
+
+    // check if there are enough threads available on both sides
+    if (!(options.threads > 0) || !(options.upstream_threads > 1))
+    {
+        std::cout << "ERROR -> in the configuration file: \n" <<
+                     "communication_threads_count should be at least 1 and upstream_threads_count at least 2 \n\n" <<
+                     "      e.g. <local ... communication_threads_count = \"1\" upstream_threads_count = \"2\"/>\n\n";
+        exit(-1);
+    }
+
+    // set slow consumer options (optional)
+    SetSlowConsumer(options.high_watermark_bytes, options.low_watermark_bytes, options.slow_consumer_policy, opt);
+
+    // set metrics options (optional)
+    options.metrics_port = opt.get<std::string>("metrics.<xmlattr>.port", "");
+    options.metrics_file = opt.get<std::string>("metrics.<xmlattr>.file", "");
+    options.metrics_interval_ms = opt.get<int>("metrics.<xmlattr>.interval_ms", 1000);
+
+    // set reconnect options (optional)
+    SetReconnect(options.reconnect_initial_ms, options.reconnect_max_ms, options.reconnect_max_attempts, opt);
+
+    // set connection options
+    SetConnections(options.connections_count, options.pubs, opt);
+}
+
+/*
+ * Sets the slow consumer options of a pub or broker (optional)
+ */
+void SetSlowConsumer(std::size_t& high_watermark_bytes,
+                     std::size_t& low_watermark_bytes,
+                     SlowConsumerPolicy& slow_consumer_policy,
+                     boost::property_tree::ptree opt)
+{
+    high_watermark_bytes = opt.get<std::size_t>("slow_consumer.<xmlattr>.high_watermark_bytes", kDefaultHighWatermarkBytes);
+    low_watermark_bytes = opt.get<std::size_t>("slow_consumer.<xmlattr>.low_watermark_bytes", kDefaultLowWatermarkBytes);
+    std::string policy = opt.get<std::string>("slow_consumer.<xmlattr>.policy", "disconnect");
+    if (policy == "disconnect")
+    {
+        slow_consumer_policy = kDisconnectSlowConsumer;
+    }
+    else if (policy == "drop_oldest")
+    {
+        slow_consumer_policy = kDropOldest;
+    }
+    else if (policy == "conflate")
+    {
+        slow_consumer_policy = kConflateTopics;
+    }
+    else if (policy == "pause")
+    {
+        slow_consumer_policy = kPauseSlowConsumer;
+    }
+    else
+    {
+        std::cout << "ERROR -> in the configuration file: \n" <<
+                     "slow_consumer policy should be disconnect, drop_oldest, conflate or pause \n\n" <<
+                     "      e.g. <slow_consumer ... policy = \"disconnect\"/>\n\n";
+        exit(-1);
+    }
+}
+
+/*
+ * Sets the reconnect options of a sub or broker (optional)
+ */
+void SetReconnect(int& initial_ms, int& max_ms, unsigned& max_attempts, boost::property_tree::ptree opt)
+{
+    initial_ms = std::max(1, opt.get<int>("reconnect.<xmlattr>.initial_ms", kDefaultReconnectInitialMs));
+    max_ms = std::max(initial_ms, opt.get<int>("reconnect.<xmlattr>.max_ms", kDefaultReconnectMaxMs));
+    max_attempts = opt.get<unsigned>("reconnect.<xmlattr>.max_attempts", 0);
+}
+
+/*
+ * Sets the remote publishers of a sub or broker
+ */
+void SetConnections(int& connections_count, std::vector<Connection>& pubs, boost::property_tree::ptree opt)
+{
+    connections_count = boost::lexical_cast<int>(opt.get_child("remote_connections.<xmlattr>.count").data());
     BOOST_FOREACH(boost::property_tree::ptree::value_type& val, opt.get_child("remote_connections"))
     {
         if (val.first == "publisher")
@@ -185,7 +532,12 @@ void SetOptions(SubOptions& options, boost::property_tree::ptree opt)
             con.pub_id = val.second.get_child("<xmlattr>.id").data();
             con.ip = val.second.get_child("<xmlattr>.ip").data();
             con.port = val.second.get_child("<xmlattr>.port").data();
-            options.pubs.push_back(con);
+            con.multicast_group = val.second.get<std::string>("<xmlattr>.multicast_group", "");
+            con.multicast_port = val.second.get<std::string>("<xmlattr>.multicast_port", "");
+            con.multicast_interface = val.second.get<std::string>("<xmlattr>.multicast_interface", "127.0.0.1");
+            con.shared_ring = val.second.get<std::string>("<xmlattr>.shared_ring", "");
+            con.topics = SplitTopics(val.second.get<std::string>("<xmlattr>.topics", ""));
+            pubs.push_back(con);
         }
     }
 }
@@ -0,0 +1,264 @@
+#include "message.h"
+
+/*
+ * Checks the schema version and that all fields lie inside the buffer
+ *  - accepts the current version and version 1
+ */
+bool MessageView::IsValid() const
+{
+    if (size_ < kMessageV1HeaderSize ||
+        (VersionField::Get(data_) != kMessageVersion && VersionField::Get(data_) != 1) ||
+        size_ < header_size())
+    {
+        return false;
+    }
+
+    std::size_t body_size = static_cast<std::size_t>(PublisherIdSizeField::Get(data_)) +
+                            TopicSizeField::Get(data_) +
+                            PayloadSizeField::Get(data_);
+    if (body_size != size_ - header_size())
+    {
+        return false;
+    }
+
+    // typed payloads have a fixed size
+    switch (payload_type())
+    {
+        case kTextPayload:
+            return true;
+        case kInt64Payload:
+        case kDoublePayload:
+            return PayloadSizeField::Get(data_) == 8;
+    }
+
+    return false;
+}
+
+/*
+ * Reads the send timestamp, 0 for a version 1 message
+ */
+boost::int64_t MessageView::send_timestamp_ns() const
+{
+    if (VersionField::Get(data_) == 1)
+    {
+        return 0;
+    }
+    return static_cast<boost::int64_t>(SendTimestampField::Get(data_));
+}
+
+/*
+ * Reads a kInt64Payload payload
+ */
+boost::int64_t MessageView::payload_int64() const
+{
+    return static_cast<boost::int64_t>(Field<boost::uint64_t, 0>::Get(payload().data));
+}
+
+/*
+ * Reads a kDoublePayload payload
+ */
+double MessageView::payload_double() const
+{
+    boost::uint64_t bits = Field<boost::uint64_t, 0>::Get(payload().data);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/*
+ * Builds an encoded message
+ *  - @fields: the message fields; publisher id and topic are cut to 65535 bytes
+ */
+std::string EncodeMessage(const MessageFields& fields)
+{
+    std::size_t id_size = std::min<std::size_t>(fields.publisher_id.size(), 0xFFFF);
+    std::size_t topic_size = std::min<std::size_t>(fields.topic.size(), 0xFFFF);
+
+    std::string message(kMessageHeaderSize, '\0');
+    VersionField::Set(&message[0], kMessageVersion);
+    PayloadTypeField::Set(&message[0], static_cast<boost::uint8_t>(fields.payload_type));
+    PublisherIdSizeField::Set(&message[0], static_cast<boost::uint16_t>(id_size));
+    TopicSizeField::Set(&message[0], static_cast<boost::uint16_t>(topic_size));
+    SequenceField::Set(&message[0], fields.sequence);
+    TimestampField::Set(&message[0], static_cast<boost::uint64_t>(fields.timestamp_ns));
+    PayloadSizeField::Set(&message[0], static_cast<boost::uint32_t>(fields.payload.size()));
+    SendTimestampField::Set(&message[0], static_cast<boost::uint64_t>(fields.send_timestamp_ns));
+
+    message.reserve(kMessageHeaderSize + id_size + topic_size + fields.payload.size());
+    message.append(fields.publisher_id, 0, id_size);
+    message.append(fields.topic, 0, topic_size);
+    message.append(fields.payload);
+
+    return message;
+}
+
+/*
+ * Encodes a kInt64Payload payload
+ */
+std::string EncodeInt64Payload(boost::int64_t value)
+{
+    std::string payload(8, '\0');
+    Field<boost::uint64_t, 0>::Set(&payload[0], static_cast<boost::uint64_t>(value));
+    return payload;
+}
+
+/*
+ * Encodes a kDoublePayload payload
+ */
+std::string EncodeDoublePayload(double value)
+{
+    boost::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return EncodeInt64Payload(static_cast<boost::int64_t>(bits));
+}
+
+/*
+ * Returns the end of the level starting at @start
+ */
+static std::size_t LevelEnd(StringRef str, std::size_t start)
+{
+    const char* dot = static_cast<const char*>(std::memchr(str.data + start, '.', str.size - start));
+    return (dot == 0) ? str.size : dot - str.data;
+}
+
+/*
+ * Returns the start of the level after the one starting at @start (npos: none left)
+ */
+static std::size_t NextLevel(StringRef str, std::size_t start)
+{
+    std::size_t end = LevelEnd(str, start);
+    return (end == str.size) ? std::string::npos : end + 1;
+}
+
+/*
+ * Returns true if the level [@start, @end) of @str is @level
+ */
+static bool IsLevel(StringRef str, std::size_t start, std::size_t end, const char* level, std::size_t size)
+{
+    return (end - start == size) && (std::memcmp(str.data + start, level, size) == 0);
+}
+
+/*
+ * Matches the pattern levels against the topic levels (npos: no level left)
+ *  - compares level by level in place
+ *  - "#" is matched greedily, like a glob's '*': only the last "#" seen is
+ *    backtracked over, so a subscriber's pattern costs pattern x topic levels at
+ *    most, however many "#" it holds
+ */
+static bool MatchLevels(StringRef pattern, StringRef topic)
+{
+    std::size_t p = (pattern.size == 0) ? std::string::npos : 0,
+                t = (topic.size == 0) ? std::string::npos : 0,
+                hash_p = std::string::npos,   // pattern level after the last "#" seen
+                hash_t = std::string::npos;   // first topic level not taken by that "#"
+    bool is_hashed = false;                   // a "#" was seen
+
+    while (t != std::string::npos)
+    {
+        if (p != std::string::npos)
+        {
+            std::size_t p_end = LevelEnd(pattern, p);
+
+            // "#": takes no level for now
+            if (IsLevel(pattern, p, p_end, "#", 1))
+            {
+                is_hashed = true;
+                hash_p = NextLevel(pattern, p);
+                hash_t = t;
+                p = hash_p;
+                continue;
+            }
+
+            // "*": any single level, otherwise the same level
+            std::size_t t_end = LevelEnd(topic, t);
+            if (IsLevel(pattern, p, p_end, "*", 1) ||
+                IsLevel(topic, t, t_end, pattern.data + p, p_end - p))
+            {
+                p = NextLevel(pattern, p);
+                t = NextLevel(topic, t);
+                continue;
+            }
+        }
+
+        // mismatch: let the last "#" take one more level
+        if (!is_hashed)
+        {
+            return false;
+        }
+        hash_t = NextLevel(topic, hash_t);
+        t = hash_t;
+        p = hash_p;
+    }
+
+    // topic consumed: only "#" may be left
+    while (p != std::string::npos && IsLevel(pattern, p, LevelEnd(pattern, p), "#", 1))
+    {
+        p = NextLevel(pattern, p);
+    }
+    return p == std::string::npos;
+}
+
+/*
+ * Matches a topic against a pattern
+ *  - topics are '.'-separated levels: "*" matches any single level, "#" any number
+ *    of levels (none included), e.g. "news.*" matches "news.eu" but not "news.eu.fr",
+ *    "news.#" matches both (and "news")
+ *  - same rules as the in-process publisher's TopicTrie (Assignment_2)
+ */
+bool TopicMatches(const std::string& pattern, StringRef topic)
+{
+    return MatchLevels(StringRef(pattern.data(), pattern.size()), topic);
+}
+
+/*
+ * Encodes a resume request payload
+ */
+std::string EncodeResumeRequest(boost::uint64_t next_sequence, boost::int64_t since_ns)
+{
+    std::string payload(kResumeRequestSize, '\0');
+    payload[0] = static_cast<char>(kResumeControl);
+    Field<boost::uint64_t, 1>::Set(&payload[0], next_sequence);
+    Field<boost::uint64_t, 9>::Set(&payload[0], static_cast<boost::uint64_t>(since_ns));
+    return payload;
+}
+
+/*
+ * Decodes a resume request payload of kResumeRequestSize bytes
+ */
+void DecodeResumeRequest(const char* payload, boost::uint64_t& next_sequence, boost::int64_t& since_ns)
+{
+    next_sequence = Field<boost::uint64_t, 1>::Get(payload);
+    since_ns = static_cast<boost::int64_t>(Field<boost::uint64_t, 9>::Get(payload));
+}
+
+/*
+ * Encodes a subscribe or unsubscribe request payload
+ *  - @pattern: cut to fit kMaxControlSize
+ */
+std::string EncodeSubscription(ControlType type, const std::string& pattern)
+{
+    std::string payload(1, static_cast<char>(type));
+    payload.append(pattern, 0, kMaxControlSize - 1);
+    return payload;
+}
+
+/*
+ * Encodes a replay request payload
+ */
+std::string EncodeReplayRequest(boost::uint64_t first_sequence, boost::uint64_t last_sequence)
+{
+    std::string payload(kReplayRequestSize, '\0');
+    payload[0] = static_cast<char>(kReplayControl);
+    Field<boost::uint64_t, 1>::Set(&payload[0], first_sequence);
+    Field<boost::uint64_t, 9>::Set(&payload[0], last_sequence);
+    return payload;
+}
+
+/*
+ * Decodes a replay request payload of kReplayRequestSize bytes
+ */
+void DecodeReplayRequest(const char* payload, boost::uint64_t& first_sequence, boost::uint64_t& last_sequence)
+{
+    first_sequence = Field<boost::uint64_t, 1>::Get(payload);
+    last_sequence = Field<boost::uint64_t, 9>::Get(payload);
+}
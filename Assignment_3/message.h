@@ -0,0 +1,183 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+/*
+ * Binary message schema (the payload of a frame)
+ *
+ *  offset  size  field
+ *       0     1  schema version
+ *       1     1  payload type
+ *       2     2  publisher id length
+ *       4     2  topic length
+ *       6     2  reserved
+ *       8     8  sequence number
+ *      16     8  timestamp (ns since the epoch, system clock)
+ *      24     4  payload length
+ *      28     8  send timestamp (ns, steady clock, set when published)
+ *      36     -  publisher id, topic, payload
+ *
+ *  - integers are big-endian, fields are read in place from the receive buffer
+ *  - the send timestamp is monotonic, it only compares between processes of one host
+ *  - version 1 messages (e.g. in older journals) have no send timestamp, their
+ *    header ends at offset 28
+ */
+const unsigned char kMessageVersion = 2;
+const std::size_t kMessageHeaderSize = 36;
+const std::size_t kMessageV1HeaderSize = 28;
+
+enum PayloadType
+{
+    kTextPayload = 0,
+    kInt64Payload = 1,
+    kDoublePayload = 2
+};
+
+/*
+ * Big-endian unsigned integer field at a fixed offset
+ */
+template <typename T, std::size_t Offset>
+struct Field
+{
+    static T Get(const char* base)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(base + Offset);
+        T value = 0;
+        for (unsigned i=0; i<sizeof(T); i++)
+        {
+            value = static_cast<T>((static_cast<boost::uint64_t>(value) << 8) | bytes[i]);
+        }
+        return value;
+    }
+
+    static void Set(char* base, T value)
+    {
+        for (unsigned i=0; i<sizeof(T); i++)
+        {
+            base[Offset + sizeof(T) - 1 - i] = static_cast<char>(static_cast<boost::uint64_t>(value) >> (8 * i));
+        }
+    }
+};
+
+// message header layout
+typedef Field<boost::uint8_t, 0>   VersionField;
+typedef Field<boost::uint8_t, 1>   PayloadTypeField;
+typedef Field<boost::uint16_t, 2>  PublisherIdSizeField;
+typedef Field<boost::uint16_t, 4>  TopicSizeField;
+typedef Field<boost::uint64_t, 8>  SequenceField;
+typedef Field<boost::uint64_t, 16> TimestampField;
+typedef Field<boost::uint32_t, 24> PayloadSizeField;
+typedef Field<boost::uint64_t, 28> SendTimestampField;
+
+/*
+ * Non-owning reference to bytes inside a message buffer
+ */
+struct StringRef
+{
+    StringRef() : data(0), size(0) {}
+    StringRef(const char* d, std::size_t s) : data(d), size(s) {}
+
+    std::string str() const {return std::string(data, size);}
+
+    const char* data;
+    std::size_t size;
+};
+
+/*
+ * Fields of a message to be encoded
+ */
+struct MessageFields
+{
+    MessageFields() : sequence(0), timestamp_ns(0), send_timestamp_ns(0), payload_type(kTextPayload) {}
+
+    std::string publisher_id;
+    boost::uint64_t sequence;
+    boost::int64_t timestamp_ns;
+    boost::int64_t send_timestamp_ns;
+    std::string topic;
+    PayloadType payload_type;
+    std::string payload;
+};
+
+/*
+ * Read-only view of an encoded message
+ *  - never copies, the buffer must outlive the view
+ *  - check IsValid() before using any other accessor
+ */
+class MessageView
+{
+    public:
+        MessageView(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+        bool IsValid() const;
+
+        // accessors
+        PayloadType payload_type() const {return static_cast<PayloadType>(PayloadTypeField::Get(data_));}
+        boost::uint64_t sequence() const {return SequenceField::Get(data_);}
+        boost::int64_t timestamp_ns() const {return static_cast<boost::int64_t>(TimestampField::Get(data_));}
+        boost::int64_t send_timestamp_ns() const;
+        std::size_t header_size() const {return VersionField::Get(data_) == 1 ? kMessageV1HeaderSize : kMessageHeaderSize;}
+        StringRef publisher_id() const {return StringRef(data_ + header_size(), PublisherIdSizeField::Get(data_));}
+        StringRef topic() const {return StringRef(publisher_id().data + publisher_id().size, TopicSizeField::Get(data_));}
+        StringRef payload() const {return StringRef(topic().data + topic().size, PayloadSizeField::Get(data_));}
+        boost::int64_t payload_int64() const;
+        double payload_double() const;
+
+    private:
+        const char* data_;
+        std::size_t size_;
+};
+
+std::string EncodeMessage(const MessageFields& fields);  // builds an encoded message
+std::string EncodeInt64Payload(boost::int64_t value);    // payload for kInt64Payload
+std::string EncodeDoublePayload(double value);           // payload for kDoublePayload
+
+bool TopicMatches(const std::string& pattern, StringRef topic);  // '*' (one level) and '#' (any levels) wildcards
+
+/*
+ * Control requests, the frames a subscriber sends to a publisher
+ *  - payload: [control type: 1][body]
+ *  - subscriptions may come before the resume request, they then apply from its replay on
+ */
+enum ControlType
+{
+    kResumeControl = 1,
+    kSubscribeControl = 2,
+    kUnsubscribeControl = 3,
+    kReplayControl = 4
+};
+
+const std::size_t kMaxControlSize = 1024;  // largest control payload
+
+/*
+ * Resume request, sent once on every connection
+ *  - body: [next sequence wanted: 8][since timestamp ns: 8]
+ *  - next sequence 0 with since 0: live messages only
+ *  - next sequence 0 with a since time: catch up from the first message at that time
+ */
+const std::size_t kResumeRequestSize = 17;
+
+std::string EncodeResumeRequest(boost::uint64_t next_sequence, boost::int64_t since_ns);
+void DecodeResumeRequest(const char* payload, boost::uint64_t& next_sequence, boost::int64_t& since_ns);
+
+/*
+ * Subscribe/unsubscribe request
+ *  - body: the topic pattern
+ *  - once a subscriber sent one, it only gets the topics matching its subscriptions
+ */
+std::string EncodeSubscription(ControlType type, const std::string& pattern);
+
+/*
+ * Replay request, sent on a resumed connection for messages lost on another transport
+ *  - body: [first sequence: 8][last sequence: 8]
+ *  - served from the replay ring (the messages it no longer holds stay missing)
+ */
+const std::size_t kReplayRequestSize = 17;
+
+std::string EncodeReplayRequest(boost::uint64_t first_sequence, boost::uint64_t last_sequence);
+void DecodeReplayRequest(const char* payload, boost::uint64_t& first_sequence, boost::uint64_t& last_sequence);
+
+#endif // MESSAGE_H
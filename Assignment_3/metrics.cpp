@@ -0,0 +1,538 @@
+#include "metrics.h"
+
+/*
+ * Builds a label set of one label
+ */
+MetricLabels Labels(const std::string& name, const std::string& value)
+{
+    return MetricLabels(1, std::make_pair(name, value));
+}
+
+/*
+ * Adds a label to a label set
+ */
+MetricLabels Labels(const MetricLabels& labels, const std::string& name, const std::string& value)
+{
+    MetricLabels result(labels);
+    result.push_back(std::make_pair(name, value));
+    return result;
+}
+
+/*
+ * Creates an empty histogram
+ */
+LatencyHistogram::LatencyHistogram() : count_(0),
+                                       sum_ns_(0)
+{
+    for (unsigned i=0; i<kLatencyBuckets; i++)
+    {
+        buckets_[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+/*
+ * Records a duration in its bucket
+ */
+void LatencyHistogram::Record(boost::int64_t duration_ns)
+{
+    boost::uint64_t duration_us = (duration_ns > 0) ? static_cast<boost::uint64_t>(duration_ns) / 1000 : 0;
+
+    // the first bucket whose bound is at or above the duration, the last one is +Inf
+    std::size_t i = 0;
+    while (i < kLatencyBuckets - 1 && duration_us > (1UL << i))
+    {
+        i++;
+    }
+
+    buckets_[i].fetch_add(1, boost::memory_order_relaxed);
+    count_.fetch_add(1, boost::memory_order_relaxed);
+    sum_ns_.fetch_add(duration_ns > 0 ? duration_ns : 0, boost::memory_order_relaxed);
+}
+
+/*
+ * Creates an empty histogram
+ */
+HdrHistogram::HdrHistogram() : count_(0),
+                               sum_ns_(0),
+                               max_ns_(0)
+{
+    for (unsigned i=0; i<kHdrBuckets; i++)
+    {
+        buckets_[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+/*
+ * Records a duration, negative ones (clock skew) as 0
+ */
+void HdrHistogram::Record(boost::int64_t duration_ns)
+{
+    boost::int64_t value = std::max<boost::int64_t>(duration_ns, 0);
+
+    buckets_[BucketOf(static_cast<boost::uint64_t>(value))].fetch_add(1, boost::memory_order_relaxed);
+    count_.fetch_add(1, boost::memory_order_relaxed);
+    sum_ns_.fetch_add(value, boost::memory_order_relaxed);
+
+    boost::int64_t max = max_ns_.load(boost::memory_order_relaxed);
+    while (value > max &&
+           !max_ns_.compare_exchange_weak(max, value, boost::memory_order_relaxed)) {}
+}
+
+/*
+ * Adds the values recorded by another histogram, e.g. to merge connections
+ */
+void HdrHistogram::Add(const HdrHistogram& other)
+{
+    for (unsigned i=0; i<kHdrBuckets; i++)
+    {
+        buckets_[i].fetch_add(other.bucket_count(i), boost::memory_order_relaxed);
+    }
+    count_.fetch_add(other.count(), boost::memory_order_relaxed);
+    sum_ns_.fetch_add(other.sum_ns(), boost::memory_order_relaxed);
+
+    boost::int64_t max = max_ns_.load(boost::memory_order_relaxed);
+    while (other.max_ns() > max &&
+           !max_ns_.compare_exchange_weak(max, other.max_ns(), boost::memory_order_relaxed)) {}
+}
+
+/*
+ * Returns the value at or below which a percentage of the recorded values lie
+ *  - @percentile: 0 to 100, 100 gives the max
+ *  - the value is the highest of its bucket, 0 if nothing was recorded
+ */
+boost::int64_t HdrHistogram::Percentile(double percentile) const
+{
+    unsigned long total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    unsigned long target = static_cast<unsigned long>(std::ceil(percentile / 100 * total));
+    target = std::min(std::max<unsigned long>(target, 1), total);
+
+    unsigned long cumulative = 0;
+    for (unsigned i=0; i<kHdrBuckets; i++)
+    {
+        cumulative += bucket_count(i);
+        if (cumulative >= target)
+        {
+            return std::min(static_cast<boost::int64_t>(HighestValueOf(i)), max_ns());
+        }
+    }
+
+    // records in progress
+    return max_ns();
+}
+
+/*
+ * Adds a counter or gauge
+ *  - @type: "counter" or "gauge"
+ */
+void MetricsSnapshot::Add(const std::string& name, const char* type, const MetricLabels& labels, double value)
+{
+    Sample sample;
+    sample.name = name;
+    sample.type = type;
+    sample.labels = labels;
+    sample.value = value;
+    sample.sum_seconds = 0;
+    samples_.push_back(sample);
+}
+
+/*
+ * Adds a copy of a latency histogram
+ */
+void MetricsSnapshot::Add(const std::string& name, const MetricLabels& labels, const LatencyHistogram& histogram)
+{
+    Sample sample;
+    sample.name = name;
+    sample.type = "histogram";
+    sample.labels = labels;
+    sample.value = histogram.count();
+    sample.sum_seconds = histogram.sum_ns() / 1e9;
+
+    unsigned long cumulative = 0;
+    for (unsigned i=0; i<kLatencyBuckets; i++)
+    {
+        cumulative += histogram.bucket(i);
+        sample.buckets.push_back(cumulative);
+    }
+    samples_.push_back(sample);
+}
+
+/*
+ * Adds the percentiles of an HDR histogram, as a summary
+ */
+void MetricsSnapshot::Add(const std::string& name, const MetricLabels& labels, const HdrHistogram& histogram)
+{
+    Sample sample;
+    sample.name = name;
+    sample.type = "summary";
+    sample.labels = labels;
+    sample.value = histogram.count();
+    sample.sum_seconds = histogram.sum_ns() / 1e9;
+
+    for (unsigned i=0; i<kSummaryQuantileCount; i++)
+    {
+        sample.quantiles.push_back(histogram.Percentile(kSummaryQuantiles[i] * 100) / 1e9);
+    }
+    samples_.push_back(sample);
+}
+
+/*
+ * Renders the Prometheus text exposition format
+ *  - the samples of a metric are written together, after its TYPE line
+ */
+std::string MetricsSnapshot::Prometheus() const
+{
+    std::ostringstream out;
+    out.precision(15);
+
+    // the samples, grouped by name in order of first appearance
+    std::vector<std::size_t> order;
+    for (unsigned i=0; i<samples_.size(); i++)
+    {
+        bool is_first = true;
+        for (unsigned j=0; j<i && is_first; j++)
+        {
+            is_first = (samples_[j].name != samples_[i].name);
+        }
+        for (unsigned j=i; j<samples_.size() && is_first; j++)
+        {
+            if (samples_[j].name == samples_[i].name)
+            {
+                order.push_back(j);
+            }
+        }
+    }
+
+    for (unsigned k=0; k<order.size(); k++)
+    {
+        const Sample& sample = samples_[order[k]];
+
+        // one TYPE line per metric name
+        if (k == 0 || samples_[order[k - 1]].name != sample.name)
+        {
+            out << "# TYPE " << sample.name << " " << sample.type << "\n";
+        }
+
+        std::ostringstream labels;
+        for (unsigned j=0; j<sample.labels.size(); j++)
+        {
+            labels << (j ? "," : "") << sample.labels[j].first << "=\"" << sample.labels[j].second << "\"";
+        }
+
+        if (sample.type == "counter" || sample.type == "gauge")
+        {
+            out << sample.name << "{" << labels.str() << "} " << sample.value << "\n";
+            continue;
+        }
+
+        for (unsigned j=0; j<sample.quantiles.size(); j++)
+        {
+            out << sample.name << "{" << labels.str() << (sample.labels.empty() ? "" : ",")
+                << "quantile=\"" << kSummaryQuantiles[j] << "\"} " << sample.quantiles[j] << "\n";
+        }
+        for (unsigned j=0; j<sample.buckets.size(); j++)
+        {
+            out << sample.name << "_bucket{" << labels.str() << (sample.labels.empty() ? "" : ",") << "le=\"";
+            if (j + 1 < sample.buckets.size())
+            {
+                out << LatencyHistogram::bound_seconds(j);
+            }
+            else
+            {
+                out << "+Inf";
+            }
+            out << "\"} " << sample.buckets[j] << "\n";
+        }
+        out << sample.name << "_sum{" << labels.str() << "} " << sample.sum_seconds << "\n";
+        out << sample.name << "_count{" << labels.str() << "} " << sample.value << "\n";
+    }
+
+    return out.str();
+}
+
+/*
+ * Renders JSON: {"metrics": [{"name", "type", "labels", "value"[, "sum", "buckets" or "quantiles"]}, ...]}
+ *  - label values are ids and endpoints, they are not escaped
+ */
+std::string MetricsSnapshot::Json() const
+{
+    std::ostringstream out;
+    out.precision(15);
+
+    out << "{\"metrics\": [";
+    for (unsigned i=0; i<samples_.size(); i++)
+    {
+        const Sample& sample = samples_[i];
+
+        out << (i ? ",\n  " : "\n  ")
+            << "{\"name\": \"" << sample.name << "\", \"type\": \"" << sample.type << "\", \"labels\": {";
+        for (unsigned j=0; j<sample.labels.size(); j++)
+        {
+            out << (j ? ", " : "") << "\"" << sample.labels[j].first << "\": \"" << sample.labels[j].second << "\"";
+        }
+        out << "}, \"value\": " << sample.value;
+
+        if (sample.type == "histogram")
+        {
+            out << ", \"sum\": " << sample.sum_seconds << ", \"buckets\": [";
+            for (unsigned j=0; j<sample.buckets.size(); j++)
+            {
+                out << (j ? ", " : "") << sample.buckets[j];
+            }
+            out << "]";
+        }
+        else if (sample.type == "summary")
+        {
+            out << ", \"sum\": " << sample.sum_seconds << ", \"quantiles\": {";
+            for (unsigned j=0; j<sample.quantiles.size(); j++)
+            {
+                out << (j ? ", " : "") << "\"" << kSummaryQuantiles[j] << "\": " << sample.quantiles[j];
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+
+    return out.str();
+}
+
+/*
+ * Starts serving HTTP on a local port
+ *  - @port: the listening port on localhost
+ */
+void MetricsExporter::Listen(const std::string& port)
+{
+    try
+    {
+        boost::asio::ip::tcp::resolver resolver(io_service_);
+        boost::asio::ip::tcp::resolver::query query("127.0.0.1", port);
+        boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
+
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Metrics on: http://" << endpoint << "/metrics" << std::endl;
+
+        Accept();
+    }
+
+    // report any exceptions
+    catch (std::exception & ex)
+    {
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Exception: " << ex.what() << std::endl;
+    }
+}
+
+/*
+ * Starts dumping JSON to a file
+ *  - @interval_ms: the time between dumps
+ */
+void MetricsExporter::StartDump(const std::string& file, int interval_ms)
+{
+    dump_file_ = file;
+    dump_interval_ms_ = interval_ms;
+    ScheduleDump();
+}
+
+/*
+ * Stops serving and dumping, before the io_service stops
+ */
+void MetricsExporter::Stop()
+{
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+    timer_.cancel(ec);
+}
+
+
+
+// ----- Private functions -----
+
+/*
+ * Returns the bucket of a value
+ *  - values under 2^kHdrSubBucketBits have a bucket each, then every power of two
+ *    is split in 2^kHdrSubBucketBits buckets of equal width
+ */
+std::size_t HdrHistogram::BucketOf(boost::uint64_t value)
+{
+    const boost::uint64_t sub_buckets = 1 << kHdrSubBucketBits;
+
+    if (value < sub_buckets)
+    {
+        return static_cast<std::size_t>(value);
+    }
+
+    unsigned magnitude = kHdrSubBucketBits;   // the highest bit set
+    while (magnitude < kHdrMaxValueBits && (value >> (magnitude + 1)) != 0)
+    {
+        magnitude++;
+    }
+    if (magnitude >= kHdrMaxValueBits)
+    {
+        return kHdrBuckets - 1;
+    }
+
+    boost::uint64_t sub_bucket = (value >> (magnitude - kHdrSubBucketBits)) - sub_buckets;
+    return static_cast<std::size_t>(sub_buckets * (magnitude - kHdrSubBucketBits + 1) + sub_bucket);
+}
+
+/*
+ * Returns the highest value of a bucket
+ */
+boost::uint64_t HdrHistogram::HighestValueOf(std::size_t bucket)
+{
+    const boost::uint64_t sub_buckets = 1 << kHdrSubBucketBits;
+
+    if (bucket < sub_buckets)
+    {
+        return bucket;
+    }
+
+    unsigned magnitude = static_cast<unsigned>((bucket - sub_buckets) / sub_buckets) + kHdrSubBucketBits;
+    boost::uint64_t sub_bucket = (bucket - sub_buckets) % sub_buckets + sub_buckets;
+    return ((sub_bucket + 1) << (magnitude - kHdrSubBucketBits)) - 1;
+}
+
+/*
+ * Accepts the next HTTP connection
+ */
+void MetricsExporter::Accept()
+{
+    boost::shared_ptr<Request> request(new Request(io_service_));
+    acceptor_.async_accept(request->socket,
+                           boost::bind(&MetricsExporter::AcceptHandler,
+                                       this,
+                                       boost::asio::placeholders::error,
+                                       request));
+}
+
+/*
+ * Reads the request head of an accepted connection
+ */
+void MetricsExporter::AcceptHandler(const boost::system::error_code& error,
+                                    boost::shared_ptr<Request> request)
+{
+    // stopped
+    if (error == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+
+    if (!error)
+    {
+        boost::asio::async_read_until(request->socket,
+                                      request->request,
+                                      "\r\n\r\n",
+                                      boost::bind(&MetricsExporter::RequestHandler,
+                                                  this,
+                                                  boost::asio::placeholders::error,
+                                                  request));
+    }
+
+    Accept();
+}
+
+/*
+ * Answers GET /metrics, anything else is not found
+ *  - the connection is closed after the response (HTTP/1.0)
+ */
+void MetricsExporter::RequestHandler(const boost::system::error_code& error,
+                                     boost::shared_ptr<Request> request)
+{
+    if (error)
+    {
+        return;
+    }
+
+    std::istream head(&request->request);
+    std::string method, path;
+    head >> method >> path;
+
+    std::string status = "200 OK",
+                body;
+    if (method == "GET" && (path == "/metrics" || path.compare(0, 9, "/metrics?") == 0))
+    {
+        MetricsSnapshot snapshot;
+        collect_(snapshot);
+        body = snapshot.Prometheus();
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    request->response = response.str();
+
+    boost::asio::async_write(request->socket,
+                             boost::asio::buffer(request->response),
+                             boost::bind(&MetricsExporter::ResponseHandler,
+                                         this,
+                                         boost::asio::placeholders::error,
+                                         request));
+}
+
+/*
+ * Closes a served connection
+ */
+void MetricsExporter::ResponseHandler(const boost::system::error_code& /* error */,
+                                      boost::shared_ptr<Request> request)
+{
+    boost::system::error_code ec;
+    request->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    request->socket.close(ec);
+}
+
+/*
+ * Waits for the next dump
+ */
+void MetricsExporter::ScheduleDump()
+{
+    timer_.expires_from_now(boost::chrono::milliseconds(dump_interval_ms_));
+    timer_.async_wait(boost::bind(&MetricsExporter::DumpHandler,
+                                  this,
+                                  boost::asio::placeholders::error));
+}
+
+/*
+ * Dumps the metrics as JSON, readers never see a partly written file
+ */
+void MetricsExporter::DumpHandler(const boost::system::error_code& error)
+{
+    // stopped
+    if (error)
+    {
+        return;
+    }
+
+    MetricsSnapshot snapshot;
+    collect_(snapshot);
+
+    std::string temp_file = dump_file_ + ".tmp";
+    std::ofstream out(temp_file.c_str());
+    out << snapshot.Json();
+    out.close();
+
+    if (!out || std::rename(temp_file.c_str(), dump_file_.c_str()) != 0)
+    {
+        std::cout << "[" << boost::this_thread::get_id()
+                  << "] Error: cannot write metrics to " << dump_file_ << std::endl;
+    }
+
+    ScheduleDump();
+}
@@ -0,0 +1,167 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+const std::size_t kLatencyBuckets = 22;  // 1 us to 2^20 us (~1 s), doubling, then +Inf
+const unsigned kHdrSubBucketBits = 5;    // 32 linear sub-buckets per power of two (~3% precision)
+const unsigned kHdrMaxValueBits = 40;    // values up to 2^40 ns (~18 min), larger ones are clamped
+const std::size_t kHdrBuckets = (1 << kHdrSubBucketBits) * (kHdrMaxValueBits - kHdrSubBucketBits + 1);
+const std::size_t kSummaryQuantileCount = 5;
+const double kSummaryQuantiles[kSummaryQuantileCount] = {0.5, 0.9, 0.99, 0.999, 1.0};  // 1.0 is the max
+
+typedef std::vector< std::pair<std::string, std::string> > MetricLabels;
+
+MetricLabels Labels(const std::string& name, const std::string& value);
+MetricLabels Labels(const MetricLabels& labels, const std::string& name, const std::string& value);
+
+/*
+ * Latency histogram with fixed power-of-two microsecond buckets
+ *  - lock-free, any thread may record or read it
+ */
+class LatencyHistogram : boost::noncopyable
+{
+    public:
+        LatencyHistogram();
+
+        void Record(boost::int64_t duration_ns);
+
+        // accessors
+        unsigned long bucket(std::size_t i) const {return buckets_[i].load(boost::memory_order_relaxed);}
+        unsigned long count() const {return count_.load(boost::memory_order_relaxed);}
+        boost::uint64_t sum_ns() const {return sum_ns_.load(boost::memory_order_relaxed);}
+        static double bound_seconds(std::size_t i) {return static_cast<double>(1UL << i) / 1e6;}
+
+    private:
+        boost::atomic<unsigned long> buckets_[kLatencyBuckets];  // per bucket, not cumulative
+        boost::atomic<unsigned long> count_;
+        boost::atomic<boost::uint64_t> sum_ns_;
+};
+
+/*
+ * HDR-style latency histogram, for percentiles
+ *  - log-linear buckets: each power of two of nanoseconds is split in 2^kHdrSubBucketBits,
+ *    so any recorded value is known to within ~3%
+ *  - lock-free, any thread may record or read it
+ */
+class HdrHistogram : boost::noncopyable
+{
+    public:
+        HdrHistogram();
+
+        void Record(boost::int64_t duration_ns);
+        void Add(const HdrHistogram& other);
+        boost::int64_t Percentile(double percentile) const;
+
+        // accessors
+        unsigned long bucket_count(std::size_t i) const {return buckets_[i].load(boost::memory_order_relaxed);}
+        unsigned long count() const {return count_.load(boost::memory_order_relaxed);}
+        boost::uint64_t sum_ns() const {return sum_ns_.load(boost::memory_order_relaxed);}
+        boost::int64_t max_ns() const {return max_ns_.load(boost::memory_order_relaxed);}
+
+    private:
+        static std::size_t BucketOf(boost::uint64_t value);
+        static boost::uint64_t HighestValueOf(std::size_t bucket);
+
+        boost::atomic<unsigned long> buckets_[kHdrBuckets];
+        boost::atomic<unsigned long> count_;
+        boost::atomic<boost::uint64_t> sum_ns_;
+        boost::atomic<boost::int64_t> max_ns_;
+};
+
+/*
+ * Point-in-time copy of a process' metrics
+ *  - filled by a collector, rendered as Prometheus text or JSON
+ */
+class MetricsSnapshot
+{
+    public:
+        void Add(const std::string& name, const char* type, const MetricLabels& labels, double value);
+        void Add(const std::string& name, const MetricLabels& labels, const LatencyHistogram& histogram);
+        void Add(const std::string& name, const MetricLabels& labels, const HdrHistogram& histogram);
+
+        std::string Prometheus() const;
+        std::string Json() const;
+
+    private:
+        struct Sample
+        {
+            std::string name;
+            std::string type;                      // counter, gauge, histogram or summary
+            MetricLabels labels;
+            double value;                          // counters and gauges, count of the others
+            std::vector<unsigned long> buckets;    // histograms, cumulative
+            std::vector<double> quantiles;         // summaries, in seconds, at kSummaryQuantiles
+            double sum_seconds;
+        };
+
+        std::vector<Sample> samples_;              // grouped by name in order of addition
+};
+
+/*
+ * Local metrics export
+ *  - serves the Prometheus text format over HTTP (GET /metrics)
+ *  - and/or dumps JSON to a file periodically (written aside, then renamed)
+ *  - runs on the given io_service, metrics are collected per request/dump
+ */
+class MetricsExporter : boost::noncopyable
+{
+    public:
+        typedef boost::function<void (MetricsSnapshot&)> Collector;
+
+        MetricsExporter(boost::asio::io_service& io_service, Collector collect) : io_service_(io_service),
+                                                                                 acceptor_(io_service),
+                                                                                 timer_(io_service),
+                                                                                 collect_(collect),
+                                                                                 dump_interval_ms_(0) {}
+
+        void Listen(const std::string& port);
+        void StartDump(const std::string& file, int interval_ms);
+        void Stop();
+
+    private:
+        // an HTTP request being served
+        struct Request
+        {
+            Request(boost::asio::io_service& io_service) : socket(io_service) {}
+
+            boost::asio::ip::tcp::socket socket;
+            boost::asio::streambuf request;
+            std::string response;
+        };
+
+        void Accept();
+        void AcceptHandler(const boost::system::error_code& error,
+                           boost::shared_ptr<Request> request);
+        void RequestHandler(const boost::system::error_code& error,
+                            boost::shared_ptr<Request> request);
+        void ResponseHandler(const boost::system::error_code& error,
+                             boost::shared_ptr<Request> request);
+        void ScheduleDump();
+        void DumpHandler(const boost::system::error_code& error);
+
+        boost::asio::io_service& io_service_;
+        boost::asio::ip::tcp::acceptor acceptor_;
+        boost::asio::basic_waitable_timer<boost::chrono::steady_clock> timer_;
+        Collector collect_;
+        std::string dump_file_;
+        int dump_interval_ms_;
+};
+
+#endif // METRICS_H
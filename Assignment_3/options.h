@@ -1,12 +1,26 @@
 #ifndef OPTIONS_H
 #define OPTIONS_H
 
+// Policies for a subscriber whose write queue reaches the high watermark
+enum SlowConsumerPolicy
+{
+    kDisconnectSlowConsumer,           // drop the connection (it may reconnect and resume)
+    kDropOldest,                       // drop queued frames down to the low watermark
+    kConflateTopics,                   // keep the newest queued frame per topic
+    kPauseSlowConsumer                 // skip new frames until the queue drains to the low watermark
+};
+
 // Struct for subscriber connections (used for the xml parser)
 struct Connection
 {
     std::string pub_id;
     std::string ip;
     std::string port;
+    std::string multicast_group;       // empty: TCP only
+    std::string multicast_port;
+    std::string multicast_interface;
+    std::string shared_ring;           // empty: no shared-memory ring
+    std::vector<std::string> topics;   // empty: all topics
 };
 
 // Struct for publisher options (used for the xml parser)
@@ -14,9 +28,33 @@ struct PubOptions
 {
     std::string pub_id;
     int threads;
+    int io_service_pool_size;
     std::string port;
     bool rand_intervals;
     int upper_bound_ms;
+    std::vector<std::string> topics;   // published in turn, empty: the pub id
+    double rate;                       // messages per second, 0: every upper_bound_ms
+    bool unlimited_rate;
+    std::size_t payload_size;          // 0: the producing thread's id only
+    std::size_t max_message_size;
+    std::size_t replay_buffer_size;
+    std::size_t high_watermark_bytes;
+    std::size_t low_watermark_bytes;
+    SlowConsumerPolicy slow_consumer_policy;
+    std::string journal_directory;     // empty: no journal
+    std::size_t journal_segment_size;
+    std::size_t journal_sync_every;
+    int journal_sync_interval_ms;
+    std::string multicast_group;       // empty: TCP only
+    std::string multicast_port;
+    std::string multicast_interface;
+    std::string shared_ring;           // empty: no shared-memory ring
+    boost::uint32_t shared_ring_slots;
+    boost::uint32_t shared_ring_slot_size;
+    bool tcp_fanout;
+    std::string metrics_port;          // empty: no HTTP metrics
+    std::string metrics_file;          // empty: no JSON dump
+    int metrics_interval_ms;
 };
 
 // Struct for subscriber options (used for the xml parser)
@@ -24,8 +62,46 @@ struct SubOptions
 {
     std::string sub_id;
     int threads;
+    int io_service_pool_size;
     int connections_count;
+    std::size_t max_message_size;
+    int processing_threads;
+    std::size_t queue_capacity;
+    boost::uint64_t catch_up_sequence;     // 0: live messages only
+    int catch_up_seconds;
+    int reconnect_initial_ms;
+    int reconnect_max_ms;
+    unsigned reconnect_max_attempts;       // 0: retry forever
+    unsigned long display_every;           // display one message in N, 0: none
+    std::string metrics_port;              // empty: no HTTP metrics
+    std::string metrics_file;              // empty: no JSON dump
+    int metrics_interval_ms;
     std::vector<Connection> pubs;
 };
 
+// Struct for broker options (used for the xml parser)
+struct BrokerOptions
+{
+    std::string broker_id;
+    int threads;                           // downstream (publishing) io threads
+    int upstream_threads;                  // upstream (subscribing) io threads, at least 2
+    int io_service_pool_size;
+    std::string port;
+    std::size_t max_message_size;
+    std::size_t queue_capacity;            // upstream messages waiting to be relayed
+    std::size_t high_watermark_bytes;
+    std::size_t low_watermark_bytes;
+    SlowConsumerPolicy slow_consumer_policy;
+    boost::uint64_t catch_up_sequence;     // 0: live messages only
+    int catch_up_seconds;
+    int reconnect_initial_ms;
+    int reconnect_max_ms;
+    unsigned reconnect_max_attempts;       // 0: retry forever
+    std::string metrics_port;              // empty: no HTTP metrics
+    std::string metrics_file;              // empty: no JSON dump
+    int metrics_interval_ms;
+    int connections_count;
+    std::vector<Connection> pubs;          // upstream pubs or brokers
+};
+
 #endif // OPTIONS_H
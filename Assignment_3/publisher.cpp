@@ -7,45 +7,142 @@
 void Publisher::Launch(PubOptions opt)
 {
     com_->InitIoService();
+    com_->set_max_message_size(opt.max_message_size);
+    com_->InitIoServicePool(opt.io_service_pool_size);
+    com_->set_replay_capacity(opt.replay_buffer_size);
+    com_->set_slow_consumer(opt.high_watermark_bytes, opt.low_watermark_bytes, opt.slow_consumer_policy);
     com_->LaunchThreads(opt.threads);
     com_->Accept(opt.port);
+
+    if (!opt.metrics_port.empty() || !opt.metrics_file.empty())
+    {
+        com_->EnableMetrics(opt.pub_id, opt.metrics_port, opt.metrics_file, opt.metrics_interval_ms);
+    }
+
+    // continue the journal's numbering, for catch-ups across restarts
+    if (!opt.journal_directory.empty())
+    {
+        sequence_ = com_->EnableJournal(opt.journal_directory, opt.journal_segment_size,
+                                        opt.journal_sync_every, opt.journal_sync_interval_ms);
+    }
+
+    if (!opt.multicast_group.empty())
+    {
+        com_->EnableMulticast(opt.multicast_group, opt.multicast_port, opt.multicast_interface, opt.tcp_fanout);
+    }
+
+    if (!opt.shared_ring.empty())
+    {
+        com_->EnableSharedRing(opt.shared_ring, opt.shared_ring_slots, opt.shared_ring_slot_size, opt.tcp_fanout);
+    }
+}
+
+/*
+ * Starts publishing on a dedicated producer thread
+ *  - leaves every communication thread to the I/O
+ */
+void Publisher::StartPublishing()
+{
+    producer_ = boost::thread(boost::bind(&Publisher::PublishData,
+                                          this));
+}
+
+/*
+ * Stops the producer thread, the subscribers stay connected
+ */
+void Publisher::StopPublishing()
+{
+    producer_.interrupt();
+    producer_.join();
+}
+
+/*
+ * Provides a clean exit
+ *  - stops the producer before the io_services
+ */
+void Publisher::Exit()
+{
+    StopPublishing();
+    com_->PrepareForExit("server");
 }
 
 /*
  * Sends a string message to all connected subscribers
- *  - loops infinately
- *  - exits on <RETURN> keystroke
- *  - thread safe
+ *  - loops infinately, on the producer thread
+ *  - paced against a steady clock deadline, so the rate does not drift with the
+ *    time spent writing; a deadline missed by more than kMaxPacingLagMs is reset
+ *  - with an unlimited rate, waits only while the subscribers' write queues are full
+ *  - exits on <RETURN> keystroke (thread interruption)
  */
 void Publisher::PublishData()
 {
-    // initialise the sleep duration
-    int sleep_duration = 0;
+    boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now();
 
     // publish even if all subscribers are disconnected (they can re-connect)
     while (com_->Running())
     {
-        // prepare the message in the form: "From pub_x [thr_ID: xxxxxxxx] "
-        std::string message("");
-        message.append("From ");
-        message.append(id_);
-        message.append(" [thr_ID: ");
-        message.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
-        message.append("] ");
-
-        com_->Write(message, 30);
-
-        // sleep so as to simulate random message emission
-        if (rand_intervals_)
+        boost::this_thread::interruption_point();
+
+        // prepare the message, its text payload in the form: "[thr_ID: xxxxxxxx]"
+        MessageFields message;
+        message.publisher_id = id_;
+        message.sequence = ++sequence_;
+        message.timestamp_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                                   boost::chrono::system_clock::now().time_since_epoch()).count();
+        message.send_timestamp_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                                        boost::chrono::steady_clock::now().time_since_epoch()).count();
+        message.topic = topics_.empty() ? id_ : topics_[sequence_ % topics_.size()];
+        message.payload_type = kTextPayload;
+        message.payload.append("[thr_ID: ");
+        message.payload.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
+        message.payload.append("]");
+        if (payload_size_ > 0)
+        {
+            message.payload.resize(payload_size_, '.');
+        }
+
+        com_->Write(EncodeMessage(message));
+
+        // as fast as the network allows
+        if (is_unlimited_rate_)
         {
-            sleep_duration = (rand() % upper_bound_ms_ + 1) * 1000;
-            usleep(sleep_duration);
+            while (com_->pending_frames() >= kUnlimitedRateBacklog * static_cast<long>(std::max<std::size_t>(com_->client_count(), 1)))
+            {
+                boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+            }
+            continue;
         }
 
-        // sleep for a while (fixed intervals)
-        else
+        // wait for the next message's deadline
+        deadline += NextInterval();
+        boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        if (now - deadline > boost::chrono::milliseconds(kMaxPacingLagMs))
         {
-            usleep(upper_bound_ms_ * 1000);
+            deadline = now;
         }
+        boost::this_thread::sleep_until(deadline);
     }
 }
+
+
+
+// ----- Private functions -----
+
+/*
+ * Returns the time until the next message
+ *  - random intervals simulate random message emission (1 to upper_bound_ms)
+ */
+boost::chrono::nanoseconds Publisher::NextInterval()
+{
+    if (rand_intervals_)
+    {
+        return boost::chrono::milliseconds(rand() % upper_bound_ms_ + 1);
+    }
+
+    if (rate_ > 0)
+    {
+        return boost::chrono::nanoseconds(static_cast<boost::int64_t>(1e9 / rate_));
+    }
+
+    return boost::chrono::milliseconds(upper_bound_ms_);
+}
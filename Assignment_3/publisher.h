@@ -3,19 +3,30 @@
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
+#include <boost/chrono.hpp>
 #include "communication.h"
+#include "message.h"
 #include "options.h"
 
+const long kUnlimitedRateBacklog = 1024;     // frames queued per subscriber before an unlimited publisher waits
+const int kMaxPacingLagMs = 1000;            // a publisher further behind its schedule skips ahead
+
 /*
  * Class representation for publishers
  */
 class Publisher
 {
     public:
-        Publisher() : com_(new Communication) {}     // initialises com
+        Publisher() : rate_(0),
+                      is_unlimited_rate_(false),
+                      payload_size_(0),
+                      sequence_(0),
+                      com_(new Communication) {}     // initialises com
         void Launch(PubOptions opt);                 // launches the pub
+        void StartPublishing();                      // starts the producer thread
+        void StopPublishing();                       // stops the producer thread
         void PublishData();                          // sends a string to subscribers
-        void Exit(){com_->PrepareForExit("server");} // provides a clean exit
+        void Exit();                                 // provides a clean exit
 
         // com accessor
         boost::shared_ptr<Communication> com(){return com_;}
@@ -24,13 +35,25 @@ class Publisher
         void set_id(std::string id) {id_ = id;}
         void set_rand_intervals(bool is_random){rand_intervals_ = is_random;}
         void set_upper_bound_ms(int up_b){upper_bound_ms_ = up_b;}
+        void set_topics(std::vector<std::string> topics){topics_ = topics;}
+        void set_rate(double rate){rate_ = rate;}
+        void set_unlimited_rate(bool is_unlimited){is_unlimited_rate_ = is_unlimited;}
+        void set_payload_size(std::size_t size){payload_size_ = size;}
 
     private:
+        boost::chrono::nanoseconds NextInterval();
+
         std::string id_;
         int upper_bound_ms_;
         bool rand_intervals_;
+        std::vector<std::string> topics_;      // published in turn, empty: the pub id
+        double rate_;                          // messages per second, 0: every upper_bound_ms
+        bool is_unlimited_rate_;               // publish as fast as the subscribers take it
+        std::size_t payload_size_;             // payload padded or cut to this size, 0: as produced
+        boost::uint64_t sequence_;             // sequence number of the last message
         boost::mutex m_;
         boost::shared_ptr<Communication> com_; // network wrapper
+        boost::thread producer_;               // runs PublishData, off the io threads
 
 };
 
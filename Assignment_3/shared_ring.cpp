@@ -0,0 +1,244 @@
+#include "shared_ring.h"
+
+/*
+ * Creates the ring, replacing any stale one of the same name
+ *  - @name: the shared memory object name
+ *  - @slot_count: the number of messages kept
+ *  - @slot_size: the largest message in bytes
+ *  - throws boost::interprocess::interprocess_exception on failure
+ */
+SharedRing::SharedRing(const std::string& name,
+                       boost::uint32_t slot_count,
+                       boost::uint32_t slot_size) : name_(name),
+                                                    is_owner_(true)
+{
+    boost::interprocess::shared_memory_object::remove(name_.c_str());
+
+    boost::uint32_t slot_stride = (sizeof(SharedRingSlot) + slot_size + 63) / 64 * 64;
+    boost::interprocess::shared_memory_object shm(boost::interprocess::create_only,
+                                                  name_.c_str(),
+                                                  boost::interprocess::read_write);
+    shm.truncate(sizeof(SharedRingHeader) + static_cast<boost::uint64_t>(slot_count) * slot_stride);
+    shm_.swap(shm);
+
+    boost::interprocess::mapped_region region(shm_, boost::interprocess::read_write);
+    region_.swap(region);
+
+    // the region is zero-filled, construct the atomics in place
+    header_ = new (region_.get_address()) SharedRingHeader;
+    slots_ = static_cast<char*>(region_.get_address()) + sizeof(SharedRingHeader);
+    header_->slot_count = slot_count;
+    header_->slot_size = slot_size;
+    header_->slot_stride = slot_stride;
+    header_->nonce = NewNonce();
+    header_->head.store(0);
+    header_->wake_word.store(0);
+    header_->waiters.store(0);
+    for (boost::uint32_t i=0; i<slot_count; i++)
+    {
+        new (slots_ + static_cast<std::size_t>(i) * slot_stride) SharedRingSlot;
+        Slot(i).version.store(0);
+    }
+
+    // let readers in
+    boost::atomic_thread_fence(boost::memory_order_release);
+    header_->magic = kSharedRingMagic;
+}
+
+/*
+ * Opens a ring created by another process
+ *  - @name: the shared memory object name
+ *  - throws boost::interprocess::interprocess_exception if it does not exist (yet)
+ */
+SharedRing::SharedRing(const std::string& name) : name_(name),
+                                                  is_owner_(false)
+{
+    boost::interprocess::shared_memory_object shm(boost::interprocess::open_only,
+                                                  name_.c_str(),
+                                                  boost::interprocess::read_write);
+    shm_.swap(shm);
+
+    boost::interprocess::mapped_region region(shm_, boost::interprocess::read_write);
+    region_.swap(region);
+
+    header_ = static_cast<SharedRingHeader*>(region_.get_address());
+    slots_ = static_cast<char*>(region_.get_address()) + sizeof(SharedRingHeader);
+
+    // the creator may still be setting it up
+    if (region_.get_size() < sizeof(SharedRingHeader) || header_->magic != kSharedRingMagic ||
+        region_.get_size() < sizeof(SharedRingHeader) + static_cast<boost::uint64_t>(header_->slot_count) * header_->slot_stride)
+    {
+        throw boost::interprocess::interprocess_exception("shared ring is not ready");
+    }
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+}
+
+/*
+ * Checks that the name still holds this ring
+ *  - returns false once the name is removed or holds a ring created since (a reader
+ *    of the old one would never see another message)
+ *  - opens the name and maps its header: call on idle, not per message
+ */
+bool SharedRing::IsCurrent() const
+{
+    try
+    {
+        boost::interprocess::shared_memory_object shm(boost::interprocess::open_only,
+                                                      name_.c_str(),
+                                                      boost::interprocess::read_only);
+
+        // not truncated yet: nothing to map
+        boost::interprocess::offset_t size = 0;
+        if (!shm.get_size(size) || size < static_cast<boost::interprocess::offset_t>(sizeof(SharedRingHeader)))
+        {
+            return false;
+        }
+
+        boost::interprocess::mapped_region region(shm, boost::interprocess::read_only, 0, sizeof(SharedRingHeader));
+        const SharedRingHeader* header = static_cast<const SharedRingHeader*>(region.get_address());
+
+        // a ring being created counts as another one
+        return header->magic == kSharedRingMagic && header->nonce == header_->nonce;
+    }
+    catch (std::exception &)
+    {
+        return false;
+    }
+}
+
+/*
+ * Unmaps the ring, the creator also removes its name
+ */
+SharedRing::~SharedRing()
+{
+    if (is_owner_)
+    {
+        boost::interprocess::shared_memory_object::remove(name_.c_str());
+    }
+}
+
+/*
+ * Writes a message into the next slot and wakes sleeping readers
+ *  - single writer only
+ *  - returns false if the message does not fit a slot
+ */
+bool SharedRing::Write(const std::string& message)
+{
+    if (message.size() > header_->slot_size)
+    {
+        return false;
+    }
+
+    boost::uint64_t sequence = header_->head.load(boost::memory_order_relaxed) + 1;
+    SharedRingSlot& slot = Slot(sequence);
+
+    slot.version.store(2 * sequence - 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+
+    slot.size = message.size();
+    std::memcpy(reinterpret_cast<char*>(&slot) + sizeof(SharedRingSlot), message.data(), message.size());
+
+    slot.version.store(2 * sequence, boost::memory_order_release);
+    header_->head.store(sequence, boost::memory_order_release);
+
+    // wake readers (futex on the shared word, so not FUTEX_PRIVATE)
+    header_->wake_word.fetch_add(1);
+    if (header_->waiters.load() > 0)
+    {
+        syscall(SYS_futex, reinterpret_cast<boost::uint32_t*>(&header_->wake_word), FUTEX_WAKE, INT_MAX, 0, 0, 0);
+    }
+
+    return true;
+}
+
+/*
+ * Reads the message at a reader's cursor
+ *  - @cursor: the next sequence to read, advanced past what was read or skipped
+ *  - @message: set to the message bytes
+ *  - @skipped: increased by the messages overwritten before they could be read
+ *  - returns false if no message was read (nothing new, or the slot was lapped)
+ */
+bool SharedRing::TryRead(boost::uint64_t& cursor,
+                         std::vector<char>& message,
+                         boost::uint64_t& skipped)
+{
+    boost::uint64_t head = header_->head.load(boost::memory_order_acquire);
+    if (cursor > head)
+    {
+        return false;
+    }
+
+    // jump to the oldest message still in the ring
+    if (head - cursor >= header_->slot_count)
+    {
+        boost::uint64_t oldest = head - header_->slot_count + 1;
+        skipped += oldest - cursor;
+        cursor = oldest;
+    }
+
+    SharedRingSlot& slot = Slot(cursor);
+    boost::uint64_t version = slot.version.load(boost::memory_order_acquire);
+
+    if (version == 2 * cursor)
+    {
+        boost::uint32_t size = std::min(slot.size, header_->slot_size);
+        const char* data = reinterpret_cast<const char*>(&slot) + sizeof(SharedRingSlot);
+        message.assign(data, data + size);
+
+        // make sure the slot was not rewritten while copying
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (slot.version.load(boost::memory_order_relaxed) == version)
+        {
+            cursor++;
+            return true;
+        }
+    }
+
+    // overwritten by a newer message
+    skipped++;
+    cursor++;
+    return false;
+}
+
+/*
+ * Sleeps until a message at or past the cursor is written
+ *  - @timeout_ms: the longest sleep, so callers can check for exit
+ */
+void SharedRing::Wait(boost::uint64_t cursor, int timeout_ms)
+{
+    header_->waiters.fetch_add(1);
+
+    boost::uint32_t word = header_->wake_word.load();
+    if (head() < cursor)
+    {
+        timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        syscall(SYS_futex, reinterpret_cast<boost::uint32_t*>(&header_->wake_word), FUTEX_WAIT, word, &timeout, 0, 0);
+    }
+
+    header_->waiters.fetch_sub(1);
+}
+
+
+
+// ----- Private functions -----
+
+/*
+ * Returns a creation nonce (wall clock nanoseconds mixed with the process id)
+ */
+boost::uint64_t SharedRing::NewNonce()
+{
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (static_cast<boost::uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec) ^
+           (static_cast<boost::uint64_t>(getpid()) << 40);
+}
+
+/*
+ * Returns the slot of a sequence number
+ */
+SharedRingSlot& SharedRing::Slot(boost::uint64_t sequence)
+{
+    return *reinterpret_cast<SharedRingSlot*>(slots_ + (sequence % header_->slot_count) * header_->slot_stride);
+}
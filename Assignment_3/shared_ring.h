@@ -0,0 +1,94 @@
+#ifndef SHARED_RING_H
+#define SHARED_RING_H
+#include <string>
+#include <vector>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <new>
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+
+const boost::uint32_t kSharedRingMagic = 0x53524E47;  // "SRNG"
+const boost::uint32_t kDefaultSharedRingSlots = 4096;
+const boost::uint32_t kDefaultSharedRingSlotSize = 512;
+
+/*
+ * Control block at the start of the shared region
+ *  - head and the wake-up word sit on their own cache lines
+ */
+struct SharedRingHeader
+{
+    boost::uint32_t magic;                      // set last by the creator
+    boost::uint32_t slot_count;
+    boost::uint32_t slot_size;                  // payload bytes per slot
+    boost::uint32_t slot_stride;                // bytes between slots
+    boost::uint64_t nonce;                      // differs for every creation of the name
+    char pad0[40];
+    boost::atomic<boost::uint64_t> head;        // sequence of the last written message
+    char pad1[56];
+    boost::atomic<boost::uint32_t> wake_word;   // futex word, bumped on every write
+    boost::atomic<boost::uint32_t> waiters;     // readers sleeping on wake_word
+    char pad2[56];
+};
+
+/*
+ * Slot header, followed by slot_size payload bytes
+ *  - version is 2*sequence once written, odd while being written (seqlock)
+ */
+struct SharedRingSlot
+{
+    boost::atomic<boost::uint64_t> version;
+    boost::uint32_t size;
+    boost::uint32_t pad;
+};
+
+/*
+ * Single-writer, multi-reader message ring in POSIX shared memory
+ *  - the publisher process creates it, subscriber processes open it by name
+ *  - the writer never waits; readers keep their own cursor and skip what they were lapped on
+ *  - idle readers sleep on a futex in the shared region
+ *  - a recreated ring (e.g. publisher restart) has a new nonce, readers check it with IsCurrent
+ */
+class SharedRing : boost::noncopyable
+{
+    public:
+        SharedRing(const std::string& name,
+                   boost::uint32_t slot_count,
+                   boost::uint32_t slot_size);       // creates the ring (writer)
+        SharedRing(const std::string& name);         // opens an existing ring (reader)
+        ~SharedRing();
+
+        bool IsCurrent() const;                      // false if the name now holds another ring
+
+        bool Write(const std::string& message);
+        bool TryRead(boost::uint64_t& cursor,
+                     std::vector<char>& message,
+                     boost::uint64_t& skipped);
+        void Wait(boost::uint64_t cursor, int timeout_ms);
+
+        // accessors
+        boost::uint64_t head() const {return header_->head.load(boost::memory_order_acquire);}
+        boost::uint32_t slot_size() const {return header_->slot_size;}
+        boost::uint32_t slot_count() const {return header_->slot_count;}
+
+    private:
+        static boost::uint64_t NewNonce();
+        SharedRingSlot& Slot(boost::uint64_t sequence);
+
+        std::string name_;
+        bool is_owner_;                                  // the creator removes the name
+        boost::interprocess::shared_memory_object shm_;
+        boost::interprocess::mapped_region region_;
+        SharedRingHeader* header_;
+        char* slots_;
+};
+
+#endif // SHARED_RING_H
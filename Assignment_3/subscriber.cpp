@@ -1,10 +1,75 @@
 #include "subscriber.h"
 
+/*
+ * Launches the sub
+ *  - @opt: the options parsed from the config file
+ *  - message display runs on its own threads, apart from the io_service threads
+ */
 void Subscriber::Launch(SubOptions opt)
 {
     com_->InitIoService();
+    com_->set_max_message_size(opt.max_message_size);
+    com_->InitIoServicePool(opt.io_service_pool_size);
+    com_->InitMessageQueue(opt.queue_capacity);
+    com_->set_catch_up(opt.catch_up_sequence, opt.catch_up_seconds);
+    com_->set_reconnect(opt.reconnect_initial_ms, opt.reconnect_max_ms, opt.reconnect_max_attempts);
     com_->LaunchThreads(opt.threads);
+    display_every_ = opt.display_every;
+
+    if (!opt.metrics_port.empty() || !opt.metrics_file.empty())
+    {
+        com_->EnableMetrics(opt.sub_id, opt.metrics_port, opt.metrics_file, opt.metrics_interval_ms);
+    }
+
+    // subscriptions are sent on connecting
+    for (unsigned i=0; i<opt.pubs.size(); i++)
+    {
+        for (unsigned j=0; j<opt.pubs[i].topics.size(); j++)
+        {
+            com_->Subscribe(opt.pubs[i].pub_id, opt.pubs[i].topics[j]);
+        }
+    }
+
     com_->Connect(opt.connections_count, opt.pubs);
+
+    for (unsigned i=0; i<opt.pubs.size(); i++)
+    {
+        if (!opt.pubs[i].multicast_group.empty())
+        {
+            com_->JoinMulticast(opt.pubs[i].pub_id, opt.pubs[i].multicast_group, opt.pubs[i].multicast_port,
+                                opt.pubs[i].multicast_interface);
+        }
+
+        if (!opt.pubs[i].shared_ring.empty())
+        {
+            com_->JoinSharedRing(opt.pubs[i].pub_id, opt.pubs[i].shared_ring);
+        }
+    }
+
+    for (int i=0; i<opt.processing_threads; i++)
+    {
+        processing_threads_.create_thread(boost::bind(&Subscriber::DisplayMessages,
+                                                      this));
+    }
+}
+
+/*
+ * Provides a clean exit
+ *  - reports the message queue metrics and the latency percentiles
+ */
+void Subscriber::Exit()
+{
+    com_->PrepareForExit("client");
+    processing_threads_.join_all();
+
+    std::cout << "[" << boost::this_thread::get_id()
+              << "] Message queue: max depth = " << com_->max_queue_depth()
+              << ", dropped = " << com_->dropped_messages()
+              << ", missing = " << com_->missing_messages()
+              << ", duplicates = " << com_->duplicate_messages()
+              << ", recovered = " << com_->recovered_messages() << std::endl;
+
+    com_->ReportLatency();
 }
 
 /*
@@ -30,40 +95,58 @@ void Subscriber::GetMessages()
 
 /*
  * Displays message(s) form publisher(s)
+ *  - takes messages off com's queue, any number of threads may run it
+ *  - reads the message fields in place from the received bytes
+ *  - displays one message in display_every_ (none if 0), the metrics count them all
+ *  - a message's processing ends once displayed (or skipped), for its latency
+ *  - only the display itself is serialised (message_mutex_), the rest runs in parallel
  */
 void Subscriber::DisplayMessages()
 {
-    while(com_->Running())
+    ReceivedMessage received;
+    std::vector<char>& message = received.bytes;
+
+    // wait until a message is read (false: exiting)
+    while(com_->WaitMessage(received))
     {
-        boost::mutex::scoped_lock display_lock(message_mutex_);
+        MessageView view(message.empty() ? 0 : &message[0], message.size());
 
-        // wait until a message is read
-        while (!com_->is_set_message())
+        if (!view.IsValid())
         {
-            com_->setting_message_condition()->wait(display_lock);
+            boost::mutex::scoped_lock display_lock(message_mutex_);
+            std::cout << "[" << boost::this_thread::get_id()
+                      << "] Error: malformed message of " << message.size() << " bytes" << std::endl;
+            continue;
         }
 
-        if (com_->Running())
+        if (display_every_ == 0 || (displayed_.fetch_add(1, boost::memory_order_relaxed) + 1) % display_every_ != 0)
         {
-            // get message from com
-            message_ = com_->message();
-
-            // append this sub's id and this thread's id
-            message_.append("to ");
-            message_.append(id_);
-            message_.append(" [thr_ID: ");
-            message_.append(boost::lexical_cast<std::string>(boost::this_thread::get_id()));
-            message_.append("]");
-
-            // display message
-            std::cout << message_ << std::endl;
-
-            com_->set_is_picked_message(true);
-            com_->set_is_set_message(false);
-            com_->getting_message_condition()->notify_one();
+            com_->MessageProcessed(received);
+            continue;
+        }
 
-            // re-initialise message
-            message_ = "";
+        // display message, along with this sub's id and this thread's id
+        boost::mutex::scoped_lock display_lock(message_mutex_);
+        StringRef publisher_id = view.publisher_id();
+        std::cout << "From ";
+        std::cout.write(publisher_id.data, publisher_id.size);
+        std::cout << " #" << view.sequence() << " ";
+        switch (view.payload_type())
+        {
+            case kTextPayload:
+                std::cout.write(view.payload().data, view.payload().size);
+                break;
+            case kInt64Payload:
+                std::cout << view.payload_int64();
+                break;
+            case kDoublePayload:
+                std::cout << view.payload_double();
+                break;
         }
+        std::cout << " to " << id_
+                  << " [thr_ID: " << boost::this_thread::get_id() << "]" << std::endl;
+        display_lock.unlock();
+
+        com_->MessageProcessed(received);
     }
 }
@@ -1,9 +1,11 @@
 #ifndef SUBSCRIBER_H
 #define SUBSCRIBER_H
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
 #include "communication.h"
+#include "message.h"
 #include "options.h"
 
 /*
@@ -13,12 +15,13 @@ class Subscriber
 {
     public:
         Subscriber() : com_(new Communication),
-                       message_("") {}
+                       display_every_(1),
+                       displayed_(0) {}
 
         void Launch(SubOptions opt);                 // launches the sub
         void GetMessages();                          // gets message(s) from pub(s)
         void DisplayMessages();                      // displays message(s)
-        void Exit(){com_->PrepareForExit("client");} // provides a clean exit
+        void Exit();                                 // provides a clean exit
 
         // com accessor
         boost::shared_ptr<Communication> com(){return com_;}
@@ -30,11 +33,12 @@ class Subscriber
     private:
         boost::shared_ptr<Communication> com_;  // network wrapper
         std::string id_;
+        unsigned long display_every_;            // display one message in N, 0: none
+        boost::atomic<unsigned long> displayed_; // messages taken off the queue
 
         boost::mutex connection_mutex_,
-                     message_mutex_;
-        std::string message_;
-        bool is_set_message_;
+                     message_mutex_;             // mutex for displaying (std::cout)
+        boost::thread_group processing_threads_; // message display threads
 };
 
 #endif // SUBSCRIBER_H